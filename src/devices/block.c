@@ -1,9 +1,50 @@
 #include "devices/block.h"
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/*! Number of dispatches a request may be passed over by the elevator
+    before it is served regardless of where it lies. */
+#define REQUEST_EXPIRE 32
+
+/*! Most batches of requests in flight at once on a driver that starts
+    transfers asynchronously. */
+#define QUEUE_DEPTH 8
+
+/*! A batch of merged requests handed to a driver's START operation. */
+struct inflight {
+    struct block_queue *queue;          /*!< Queue it came from. */
+    bool busy;                          /*!< In flight? */
+    struct block_request *batch[BLOCK_MAX_MERGE_SECTORS]; /*!< Requests. */
+    size_t cnt;                         /*!< Number of requests in BATCH. */
+};
+
+/*! Requests waiting for a device, served by the device's own I/O thread
+    in C-LOOK order: ascending by sector from the last position, then
+    back to the lowest pending sector. */
+struct block_queue {
+    struct lock lock;                   /*!< Protects the members below. */
+    struct condition nonempty;          /*!< Signaled when requests arrive. */
+    struct list sorted;                 /*!< Pending requests by sector. */
+    struct list fifo;                   /*!< Pending requests by arrival. */
+    block_sector_t head;                /*!< Sector past the last dispatch. */
+    unsigned long long dispatch_cnt;    /*!< Number of dispatches so far. */
+    struct block *block;                /*!< Device served. */
+    uint8_t *bounce;                    /*!< Staging for merged requests
+                                             whose buffers are scattered. */
+
+    struct inflight inflight[QUEUE_DEPTH]; /*!< Batches in flight. */
+    struct semaphore free_inflight;     /*!< Number of idle INFLIGHT. */
+};
 
 /*! A block device. */
 struct block {
@@ -18,6 +59,16 @@ struct block {
 
     unsigned long long read_cnt;        /*!< Number of sectors read. */
     unsigned long long write_cnt;       /*!< Number of sectors written. */
+
+    struct block *parent;               /*!< Device this one is part of. */
+    block_sector_t parent_start;        /*!< First sector within PARENT. */
+    struct block_queue *queue;          /*!< Request queue, once needed. */
+
+    /* Instrumentation, updated with interrupts off since requests may
+       complete in interrupt context.  A partition's requests count both
+       for it and for the device its queue belongs to. */
+    struct blockstat stats;             /*!< Counters and histograms. */
+    block_sector_t next_sector;         /*!< End of the last request. */
 };
 
 /*! List of all block devices. */
@@ -93,14 +144,37 @@ static void check_sector(struct block *block, block_sector_t sector) {
     }
 }
 
+static void wake_submitter(struct block_request *);
+
+/*! Transfers CNT sectors starting at SECTOR between BLOCK and BUFFER
+    through BLOCK's request queue, and waits for the transfer to finish. */
+static void transfer_and_wait(struct block *block, block_sector_t sector,
+                              size_t cnt, void *buffer, bool write) {
+    struct semaphore done;
+    struct block_request r;
+
+    sema_init(&done, 0);
+    r.sector = sector;
+    r.cnt = cnt;
+    r.buffer = buffer;
+    r.write = write;
+    r.complete = wake_submitter;
+    r.aux = &done;
+    block_submit(block, &r);
+    sema_down(&done);
+}
+
+/*! Completion function for transfer_and_wait(). */
+static void wake_submitter(struct block_request *r) {
+    sema_up(r->aux);
+}
+
 /*! Reads sector SECTOR from BLOCK into BUFFER, which must
     have room for BLOCK_SECTOR_SIZE bytes.
     Internally synchronizes accesses to block devices, so external
     per-block device locking is unneeded. */
 void block_read(struct block *block, block_sector_t sector, void *buffer) {
-    check_sector(block, sector);
-    block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
+    block_read_multiple(block, sector, 1, buffer);
 }
 
 /*! Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -110,10 +184,374 @@ void block_read(struct block *block, block_sector_t sector, void *buffer) {
     per-block device locking is unneeded. */
 void block_write(struct block *block, block_sector_t sector,
                  const void *buffer) {
-    check_sector(block, sector);
-    ASSERT(block->type != BLOCK_FOREIGN);
-    block->ops->write(block->aux, sector, buffer);
-    block->write_cnt++;
+    block_write_multiple(block, sector, 1, buffer);
+}
+
+/*! Reads CNT consecutive sectors starting at SECTOR from BLOCK into
+    BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  The
+    driver transfers them with as few device commands as it can.
+    Internally synchronizes accesses to block devices, so external
+    per-block device locking is unneeded. */
+void block_read_multiple(struct block *block, block_sector_t sector,
+                         size_t cnt, void *buffer) {
+    if (cnt > 0)
+        transfer_and_wait(block, sector, cnt, buffer, false);
+}
+
+/*! Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+    BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after
+    the block device has acknowledged receiving all of the data.
+    Internally synchronizes accesses to block devices, so external
+    per-block device locking is unneeded. */
+void block_write_multiple(struct block *block, block_sector_t sector,
+                          size_t cnt, const void *buffer) {
+    if (cnt > 0)
+        transfer_and_wait(block, sector, cnt, (void *) buffer, true);
+}
+
+/* Request queues. */
+
+static void io_thread(void *block_);
+
+/*! Returns the request queue of BLOCK, creating it and starting its I/O
+    thread on first use. */
+static struct block_queue *get_queue(struct block *block) {
+    struct block_queue *q;
+    enum intr_level old_level;
+    bool installed;
+    size_t i;
+
+    if (block->queue != NULL)
+        return block->queue;
+
+    q = malloc(sizeof *q);
+    if (q == NULL)
+        PANIC("Failed to allocate memory for block request queue");
+    lock_init(&q->lock);
+    cond_init(&q->nonempty);
+    list_init(&q->sorted);
+    list_init(&q->fifo);
+    q->block = block;
+    q->head = 0;
+    q->dispatch_cnt = 0;
+    for (i = 0; i < QUEUE_DEPTH; i++) {
+        q->inflight[i].queue = q;
+        q->inflight[i].busy = false;
+    }
+    sema_init(&q->free_inflight, QUEUE_DEPTH);
+    q->bounce = palloc_get_multiple(PAL_ASSERT, DIV_ROUND_UP(
+        BLOCK_MAX_MERGE_SECTORS * BLOCK_SECTOR_SIZE, PGSIZE));
+
+    /* Someone else may have beaten us to it. */
+    old_level = intr_disable();
+    installed = block->queue == NULL;
+    if (installed)
+        block->queue = q;
+    intr_set_level(old_level);
+
+    if (installed) {
+        /* Nothing else would ever dispatch the queue's requests. */
+        if (thread_create(block->name, PRI_MAX, io_thread, block) == TID_ERROR)
+            PANIC("Failed to start I/O thread for block device %s",
+                  block->name);
+    } else {
+        palloc_free_multiple(q->bounce, DIV_ROUND_UP(
+            BLOCK_MAX_MERGE_SECTORS * BLOCK_SECTOR_SIZE, PGSIZE));
+        free(q);
+    }
+    return block->queue;
+}
+
+/*! Orders requests by sector on the queue's device. */
+static bool request_less(const struct list_elem *a_,
+                         const struct list_elem *b_, void *aux UNUSED) {
+    const struct block_request *a =
+        list_entry(a_, struct block_request, sorted_elem);
+    const struct block_request *b =
+        list_entry(b_, struct block_request, sorted_elem);
+    return a->dev_sector < b->dev_sector;
+}
+
+/*! Counts a request R arriving at BLOCK at SECTOR.
+    Interrupts must be off. */
+static void note_submit(struct block *block, const struct block_request *r,
+                        block_sector_t sector) {
+    struct blockstat *s = &block->stats;
+
+    if (sector == block->next_sector)
+        s->sequential_cnt++;
+    else
+        s->random_cnt++;
+    block->next_sector = sector + r->cnt;
+    s->origin_cnt[r->origin->type]++;
+    if (++s->depth > s->max_depth)
+        s->max_depth = s->depth;
+}
+
+/*! Counts request R, which took CYCLES, completing on BLOCK.
+    Interrupts must be off. */
+static void note_complete(struct block *block, const struct block_request *r,
+                          uint64_t cycles) {
+    struct blockstat *s = &block->stats;
+    uint64_t c = cycles >> BLOCKSTAT_BUCKET_SHIFT;
+    int bucket = 0;
+
+    s->depth--;
+    if (r->write) {
+        s->write_cnt++;
+        s->write_bytes += r->cnt * BLOCK_SECTOR_SIZE;
+    }
+    else {
+        s->read_cnt++;
+        s->read_bytes += r->cnt * BLOCK_SECTOR_SIZE;
+    }
+    while (c > 0 && bucket < BLOCKSTAT_BUCKETS - 1) {
+        c >>= 1;
+        bucket++;
+    }
+    s->latency[bucket]++;
+    s->total_cycles += cycles;
+}
+
+/*! Accounts for request R finishing on DEV, the device whose queue it went
+    through, then hands it back to its submitter. */
+static void complete_request(struct block *dev, struct block_request *r) {
+    uint64_t cycles = timer_cycles() - r->submit_cycles;
+    enum intr_level old_level = intr_disable();
+    note_complete(r->origin, r, cycles);
+    if (dev != r->origin)
+        note_complete(dev, r, cycles);
+    intr_set_level(old_level);
+
+    r->complete(r);
+}
+
+/*! Queues request R for BLOCK and returns without waiting for it.  R's
+    COMPLETE function is called from BLOCK's I/O thread once the transfer
+    is done.  Requests for a partition join the queue of the device it is
+    part of, so that they are ordered and merged with all other traffic to
+    that device. */
+void block_submit(struct block *block, struct block_request *r) {
+    struct block_queue *q;
+    enum intr_level old_level;
+
+    ASSERT(r->cnt > 0);
+    ASSERT(r->complete != NULL);
+    check_sector(block, r->sector);
+    check_sector(block, r->sector + r->cnt - 1);
+    if (r->write) {
+        ASSERT(block->type != BLOCK_FOREIGN);
+        block->write_cnt += r->cnt;
+    }
+    else
+        block->read_cnt += r->cnt;
+
+    r->dev_sector = r->sector;
+    r->origin = block;
+    while (block->parent != NULL) {
+        r->dev_sector += block->parent_start;
+        block = block->parent;
+    }
+
+    old_level = intr_disable();
+    note_submit(r->origin, r, r->sector);
+    if (block != r->origin)
+        note_submit(block, r, r->dev_sector);
+    intr_set_level(old_level);
+    r->submit_cycles = timer_cycles();
+
+    q = get_queue(block);
+    lock_acquire(&q->lock);
+    r->deadline = q->dispatch_cnt + REQUEST_EXPIRE;
+    list_insert_ordered(&q->sorted, &r->sorted_elem, request_less, NULL);
+    list_push_back(&q->fifo, &r->fifo_elem);
+    cond_signal(&q->nonempty, &q->lock);
+    lock_release(&q->lock);
+}
+
+/*! Chooses the request Q serves next: the oldest one if it has waited past
+    its deadline, otherwise the next one in C-LOOK order.
+    Q's lock must be held and Q must not be empty. */
+static struct block_request *pick_next(struct block_queue *q) {
+    struct block_request *oldest =
+        list_entry(list_front(&q->fifo), struct block_request, fifo_elem);
+    struct list_elem *e;
+
+    if (oldest->deadline <= q->dispatch_cnt)
+        return oldest;
+
+    for (e = list_begin(&q->sorted); e != list_end(&q->sorted);
+         e = list_next(e)) {
+        struct block_request *r =
+            list_entry(e, struct block_request, sorted_elem);
+        if (r->dev_sector >= q->head)
+            return r;
+    }
+    return list_entry(list_front(&q->sorted), struct block_request,
+                      sorted_elem);
+}
+
+/*! Waits for Q to have requests, then removes the next one along with any
+    that continue it in the same direction, up to BLOCK_MAX_MERGE_SECTORS in
+    all.  If CONTIGUOUS is true, only requests whose buffers continue the
+    batch's buffer are merged.  Stores them in BATCH in sector order and
+    returns how many. */
+static size_t next_batch(struct block_queue *q, struct block_request *batch[],
+                         bool contiguous) {
+    struct block_request *first;
+    struct list_elem *e;
+    size_t cnt, sectors;
+
+    lock_acquire(&q->lock);
+    while (list_empty(&q->sorted))
+        cond_wait(&q->nonempty, &q->lock);
+
+    first = pick_next(q);
+    e = list_remove(&first->sorted_elem);
+    list_remove(&first->fifo_elem);
+    batch[0] = first;
+    cnt = 1;
+    sectors = first->cnt;
+
+    while (e != list_end(&q->sorted)) {
+        struct block_request *r =
+            list_entry(e, struct block_request, sorted_elem);
+        if (r->write != first->write ||
+            r->dev_sector != first->dev_sector + sectors ||
+            sectors + r->cnt > BLOCK_MAX_MERGE_SECTORS ||
+            (contiguous && r->buffer != (uint8_t *) first->buffer
+                                        + sectors * BLOCK_SECTOR_SIZE))
+            break;
+        e = list_remove(&r->sorted_elem);
+        list_remove(&r->fifo_elem);
+        batch[cnt++] = r;
+        sectors += r->cnt;
+    }
+
+    q->head = first->dev_sector + sectors;
+    q->dispatch_cnt++;
+    lock_release(&q->lock);
+    return cnt;
+}
+
+/*! Has BLOCK's driver transfer CNT sectors starting at SECTOR between the
+    device and BUFFER, in as few operations as the driver allows. */
+static void transfer(struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer, bool write) {
+    const struct block_operations *ops = block->ops;
+    uint8_t *p = buffer;
+    size_t i;
+
+    if (write && ops->write_multiple != NULL)
+        ops->write_multiple(block->aux, sector, cnt, buffer);
+    else if (!write && ops->read_multiple != NULL)
+        ops->read_multiple(block->aux, sector, cnt, buffer);
+    else {
+        for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE) {
+            if (write)
+                ops->write(block->aux, sector + i, p);
+            else
+                ops->read(block->aux, sector + i, p);
+        }
+    }
+}
+
+/*! Carries out the CNT requests in BATCH, which cover consecutive sectors
+    in one direction, as a single transfer.  Goes through Q's bounce buffer
+    unless the requests' buffers happen to be consecutive too. */
+static void dispatch(struct block *block, struct block_queue *q,
+                     struct block_request *batch[], size_t cnt) {
+    struct block_request *first = batch[0];
+    bool write = first->write;
+    bool contiguous = true;
+    size_t sectors = first->cnt;
+    uint8_t *p;
+    size_t i;
+
+    for (i = 1; i < cnt; i++) {
+        if (batch[i]->buffer != (uint8_t *) first->buffer
+                                + sectors * BLOCK_SECTOR_SIZE)
+            contiguous = false;
+        sectors += batch[i]->cnt;
+    }
+
+    if (contiguous) {
+        transfer(block, first->dev_sector, sectors, first->buffer, write);
+        return;
+    }
+
+    if (write) {
+        for (i = 0, p = q->bounce; i < cnt; p += batch[i++]->cnt * BLOCK_SECTOR_SIZE)
+            memcpy(p, batch[i]->buffer, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+    }
+    transfer(block, first->dev_sector, sectors, q->bounce, write);
+    if (!write) {
+        for (i = 0, p = q->bounce; i < cnt; p += batch[i++]->cnt * BLOCK_SECTOR_SIZE)
+            memcpy(batch[i]->buffer, p, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/*! Completes every request of in-flight batch F_ and makes F_ available
+    again.  Called by drivers through their START operation. */
+static void finish_inflight(void *f_) {
+    struct inflight *f = f_;
+    size_t i;
+
+    for (i = 0; i < f->cnt; i++)
+        complete_request(f->queue->block, f->batch[i]);
+    f->busy = false;
+    sema_up(&f->queue->free_inflight);
+}
+
+/*! Takes an idle in-flight batch from Q, waiting for one if need be. */
+static struct inflight *get_inflight(struct block_queue *q) {
+    enum intr_level old_level;
+    struct inflight *f;
+
+    sema_down(&q->free_inflight);
+    old_level = intr_disable();
+    for (f = q->inflight; f->busy; f++)
+        ASSERT(f < q->inflight + QUEUE_DEPTH - 1);
+    f->busy = true;
+    intr_set_level(old_level);
+    return f;
+}
+
+/*! Serves BLOCK's request queue forever.  If BLOCK's driver can start
+    transfers asynchronously, keeps up to QUEUE_DEPTH batches in flight;
+    otherwise carries out one batch at a time. */
+static void io_thread(void *block_) {
+    struct block *block = block_;
+    struct block_queue *q = block->queue;
+
+    for (;;) {
+        size_t i, sectors;
+
+        if (block->ops->start == NULL) {
+            struct block_request *batch[BLOCK_MAX_MERGE_SECTORS];
+            size_t cnt = next_batch(q, batch, false);
+
+            dispatch(block, q, batch, cnt);
+            for (i = 0; i < cnt; i++)
+                complete_request(block, batch[i]);
+            continue;
+        }
+
+        struct inflight *f = get_inflight(q);
+        f->cnt = next_batch(q, f->batch, true);
+        for (i = 0, sectors = 0; i < f->cnt; i++)
+            sectors += f->batch[i]->cnt;
+
+        if (sectors <= BLOCK_MAX_MERGE_SECTORS)
+            block->ops->start(block->aux, f->batch[0]->dev_sector, sectors,
+                              f->batch[0]->buffer, f->batch[0]->write,
+                              finish_inflight, f);
+        else {
+            /* A single request too big to start; do it the slow way. */
+            dispatch(block, q, f->batch, f->cnt);
+            finish_inflight(f);
+        }
+    }
 }
 
 /*! Returns the number of sectors in BLOCK. */
@@ -131,8 +569,12 @@ enum block_type block_type(struct block *block) {
     return block->type;
 }
 
-/*! Prints statistics for each block device used for a Pintos role. */
+static void print_device_stats(struct block *);
+
+/*! Prints statistics for each block device used for a Pintos role, then
+    detailed statistics for every block device that saw any requests. */
 void block_print_stats(void) {
+    struct list_elem *e;
     int i;
 
     for (i = 0; i < BLOCK_ROLE_CNT; i++) {
@@ -143,6 +585,56 @@ void block_print_stats(void) {
                    block->read_cnt, block->write_cnt);
         }
     }
+
+    for (e = list_begin(&all_blocks); e != list_end(&all_blocks);
+         e = list_next(e))
+        print_device_stats(list_entry(e, struct block, list_elem));
+}
+
+/*! Prints BLOCK's request statistics, if it has had any requests. */
+static void print_device_stats(struct block *block) {
+    struct blockstat s;
+    unsigned long long cnt;
+    int i;
+
+    block_get_stats(block, &s);
+    cnt = s.read_cnt + s.write_cnt;
+    if (cnt == 0)
+        return;
+
+    printf("%s: %llu reads (%llu bytes), %llu writes (%llu bytes), "
+           "%llu sequential, %llu random, max depth %u, "
+           "mean latency %llu cycles\n",
+           block->name, s.read_cnt, s.read_bytes, s.write_cnt,
+           s.write_bytes, s.sequential_cnt, s.random_cnt, s.max_depth,
+           s.total_cycles / cnt);
+
+    printf("%s: requests by issuer:", block->name);
+    for (i = 0; i < BLOCKSTAT_ORIGINS; i++)
+        if (s.origin_cnt[i] != 0)
+            printf(" %s %llu", block_type_name(i), s.origin_cnt[i]);
+    printf("\n");
+
+    printf("%s: latency histogram (cycles):", block->name);
+    for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+        if (s.latency[i] != 0) {
+            if (i == BLOCKSTAT_BUCKETS - 1)
+                printf(" >=%llu:%llu",
+                       1ULL << (i + BLOCKSTAT_BUCKET_SHIFT - 1), s.latency[i]);
+            else
+                printf(" <%llu:%llu",
+                       1ULL << (i + BLOCKSTAT_BUCKET_SHIFT), s.latency[i]);
+        }
+    printf("\n");
+}
+
+/*! Copies BLOCK's request statistics into *S.  A partition's statistics
+    cover its own requests; a whole disk's cover every request to it,
+    including those that came through its partitions. */
+void block_get_stats(struct block *block, struct blockstat *s) {
+    enum intr_level old_level = intr_disable();
+    *s = block->stats;
+    intr_set_level(old_level);
 }
 
 /*! Registers a new block device with the given NAME.  If EXTRA_INFO is
@@ -164,6 +656,11 @@ struct block * block_register(const char *name, enum block_type type,
     block->aux = aux;
     block->read_cnt = 0;
     block->write_cnt = 0;
+    block->parent = NULL;
+    block->parent_start = 0;
+    block->queue = NULL;
+    memset(&block->stats, 0, sizeof block->stats);
+    block->next_sector = 0;
 
     printf("%s: %'"PRDSNu" sectors (", block->name, block->size);
     print_human_readable_size((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -175,6 +672,17 @@ struct block * block_register(const char *name, enum block_type type,
     return block;
 }
 
+/*! Records that BLOCK consists of the sectors of PARENT starting at START,
+    as for a partition.  Requests for BLOCK then go straight to PARENT's
+    queue instead of through BLOCK's own operations. */
+void block_set_parent(struct block *block, struct block *parent,
+                      block_sector_t start) {
+    ASSERT(block->queue == NULL);
+    ASSERT(start + block->size <= parent->size);
+    block->parent = parent;
+    block->parent_start = start;
+}
+
 /*! Returns the block device corresponding to LIST_ELEM, or a null
     pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block * list_elem_to_block(struct list_elem *list_elem) {
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <blockstat.h>
 
 /*! Size of a block device sector in bytes.  All IDE disks use this sector
     size, as do most USB and SCSI disks.  It's not worth it to try to cater
@@ -52,22 +55,84 @@ struct block *block_next(struct block *);
 block_sector_t block_size(struct block *);
 void block_read(struct block *, block_sector_t, void *);
 void block_write(struct block *, block_sector_t, const void *);
+void block_read_multiple(struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple(struct block *, block_sector_t, size_t cnt,
+                          const void *);
 const char *block_name(struct block *);
 enum block_type block_type(struct block *);
 
+/* Asynchronous requests. */
+struct block_request;
+
+/*! Called once a request has finished, from the device's I/O thread or,
+    for drivers that transfer asynchronously, from the device's interrupt
+    handler.  Must not sleep. */
+typedef void block_complete_func(struct block_request *);
+
+/*! A request to transfer CNT consecutive sectors starting at SECTOR
+    between a block device and BUFFER, which must be in kernel memory.
+    The submitter fills in the public members and keeps the request alive
+    until COMPLETE has been called. */
+struct block_request {
+    block_sector_t sector;              /*!< First sector. */
+    size_t cnt;                         /*!< Number of sectors. */
+    void *buffer;                       /*!< CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /*!< Write to the device? */
+    block_complete_func *complete;      /*!< Called when done. */
+    void *aux;                          /*!< For COMPLETE's use. */
+
+    /*! Owned by the block layer. @{ */
+    block_sector_t dev_sector;          /*!< SECTOR on the queue's device. */
+    struct block *origin;               /*!< Device it was submitted to. */
+    uint64_t submit_cycles;             /*!< When it was submitted. */
+    unsigned long long deadline;        /*!< Dispatch count to serve it by. */
+    struct list_elem sorted_elem;       /*!< Element in queue, by sector. */
+    struct list_elem fifo_elem;         /*!< Element in queue, by arrival. */
+    /*! @} */
+};
+
+void block_submit(struct block *, struct block_request *);
+
 /* Statistics. */
 void block_print_stats(void);
+void block_get_stats(struct block *, struct blockstat *);
 
 /* Lower-level interface to block device drivers. */
 
+/*! Most sectors the block layer hands a driver in one operation after
+    merging adjacent requests.  Larger single requests still reach
+    READ_MULTIPLE and WRITE_MULTIPLE unsplit. */
+#define BLOCK_MAX_MERGE_SECTORS 64
+
+/*! Called by a driver, possibly from its interrupt handler, when a transfer
+    started with START is done. */
+typedef void block_done_func(void *aux);
+
+/*! Driver operations.  READ_MULTIPLE and WRITE_MULTIPLE transfer CNT
+    consecutive sectors at once; they may be null, in which case the block
+    layer falls back to one READ or WRITE per sector.
+
+    START, which may also be null, begins a transfer of at most
+    BLOCK_MAX_MERGE_SECTORS sectors and returns without waiting for it,
+    calling DONE(DONE_AUX) once it is complete.  It may block until the
+    device has room for another transfer.  Drivers that provide it get
+    several requests in flight at once. */
 struct block_operations {
     void (*read)(void *aux, block_sector_t, void *buffer);
     void (*write)(void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple)(void *aux, block_sector_t, size_t cnt,
+                          void *buffer);
+    void (*write_multiple)(void *aux, block_sector_t, size_t cnt,
+                           const void *buffer);
+    void (*start)(void *aux, block_sector_t, size_t cnt, void *buffer,
+                  bool write, block_done_func *done, void *done_aux);
 };
 
 struct block *block_register(const char *name, enum block_type,
                              const char *extra_info, block_sector_t size,
                              const struct block_operations *, void *aux);
+void block_set_parent(struct block *, struct block *parent,
+                      block_sector_t start);
 
 #endif /* devices/block.h */
 
@@ -1,7 +1,12 @@
 /*! \file ide.c
 
    The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use bus-master DMA when the controller is a PCI IDE
+   controller with a bus-master interface, like the PIIX that QEMU and
+   Bochs emulate, and the disk supports it.  Otherwise they fall back to
+   programmed I/O. */
 
 #include "devices/ide.h"
 #include <ctype.h>
@@ -10,10 +15,14 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /*! ATA command block port addresses. @{ */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)    /*!< Data. */
@@ -34,10 +43,29 @@
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)      /*!< Alt Status (r/o). */
 /*! @} */
 
+/*! Bus master IDE port addresses, relative to the channel's bus master
+    base.  See [PIIX] for details. @{ */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /*!< Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /*!< Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /*!< PRD table. */
+/*! @} */
+
+/*! Bus master command register bits. @{ */
+#define BM_CMD_START 0x01       /*!< Start transfer. */
+#define BM_CMD_READ 0x08        /*!< Transfer from disk to memory. */
+/*! @} */
+
+/*! Bus master status register bits.  Writing 1 clears ERROR and INTR. @{ */
+#define BM_STA_ACTIVE 0x01      /*!< Transfer in progress. */
+#define BM_STA_ERROR 0x02       /*!< Transfer failed. */
+#define BM_STA_INTR 0x04        /*!< Disk raised its interrupt. */
+/*! @} */
+
 /*! Alternate Status Register bits. @{ */
 #define STA_BSY 0x80            /*!< Busy. */
 #define STA_DRDY 0x40           /*!< Device Ready. */
 #define STA_DRQ 0x08            /*!< Data Request. */
+#define STA_ERR 0x01            /*!< Error. */
 /*! @} */
 
 /*! Control Register bits. @{ */
@@ -55,14 +83,35 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /*!< IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /*!< READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /*!< WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /*!< READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /*!< WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /*!< SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /*!< READ DMA. */
+#define CMD_WRITE_DMA 0xca              /*!< WRITE DMA. */
 /*! @} */
 
+/*! Most sectors a single READ or WRITE command can transfer.  A sector
+    count register value of 0 means this many. */
+#define MAX_TRANSFER_SECTORS 256
+
+/*! A physical region descriptor: one physically contiguous piece of a
+    DMA transfer.  A piece may not cross a 64 kB boundary. */
+struct prd {
+    uint32_t addr;              /*!< Physical address. */
+    uint16_t size;              /*!< Size in bytes; 0 means 64 kB. */
+    uint16_t flags;             /*!< PRD_EOT on the last descriptor. */
+};
+#define PRD_EOT 0x8000          /*!< End of table. */
+
 /*! An ATA device. */
 struct ata_disk {
     char name[8];               /*!< Name, e.g. "hda". */
     struct channel *channel;    /*!< Channel that disk is attached to. */
     int dev_no;                 /*!< Device 0 or 1 for master or slave. */
     bool is_ata;                /*!< Is device an ATA disk? */
+    int multiple;               /*!< Sectors per interrupt under READ/WRITE
+                                     MULTIPLE, or 1 if not in use. */
+    bool dma;                   /*!< Transfer with bus-master DMA? */
 };
 
 /*! An ATA channel (aka controller).
@@ -71,12 +120,18 @@ struct channel {
     char name[8];               /*!< Name, e.g. "ide0". */
     uint16_t reg_base;          /*!< Base I/O port. */
     uint8_t irq;                /*!< Interrupt in use. */
+    uint16_t bm_base;           /*!< Bus master base port, or 0 if none. */
+    struct prd *prdt;           /*!< PRD table, if BM_BASE is nonzero. */
 
     struct lock lock;           /*!< Must acquire to access the controller. */
     bool expecting_interrupt;   /*!< True if an interrupt is expected, false if
                                      any interrupt would be spurious. */
     struct semaphore completion_wait;   /*!< Up'd by interrupt handler. */
 
+    struct semaphore probed;    /*!< Up'd once probe_channel() is done. */
+    char (*ids)[BLOCK_SECTOR_SIZE]; /*!< IDENTIFY DEVICE data for each
+                                         device, while probing. */
+
     struct ata_disk devices[2];     /*!< The devices on this channel. */
 };
 
@@ -88,12 +143,23 @@ static struct block_operations ide_operations;
 
 static void reset_channel(struct channel *);
 static bool check_device_type(struct ata_disk *);
-static void identify_ata_device(struct ata_disk *);
+static void probe_channel(void *);
+static void identify_ata_device(struct ata_disk *, char *id);
+static void register_ata_device(struct ata_disk *, char *id);
 
-static void select_sector(struct ata_disk *, block_sector_t);
+static void enable_multiple_mode(struct ata_disk *, int max_multiple);
+static void select_sector(struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command(struct channel *, uint8_t command);
-static void input_sector(struct channel *, void *);
-static void output_sector(struct channel *, const void *);
+static void input_sectors(struct channel *, void *, size_t cnt);
+static void output_sectors(struct channel *, const void *, size_t cnt);
+
+static void pio_read(struct ata_disk *, block_sector_t, size_t cnt, void *);
+static void pio_write(struct ata_disk *, block_sector_t, size_t cnt,
+                      const void *);
+static bool dma_transfer(struct ata_disk *, block_sector_t, size_t cnt,
+                         const void *, bool write);
+
+static uint16_t find_bus_master(void);
 
 static void wait_until_idle(const struct ata_disk *);
 static bool wait_while_busy(const struct ata_disk *);
@@ -104,6 +170,7 @@ static void interrupt_handler(struct intr_frame *);
 
 /*! Initialize the disk subsystem and detect disks. */
 void ide_init (void) {
+    uint16_t bm_base = find_bus_master();
     size_t chan_no;
 
     for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -124,6 +191,14 @@ void ide_init (void) {
         default:
             NOT_REACHED();
         }
+        if (bm_base != 0) {
+            c->bm_base = bm_base + chan_no * 8;
+            c->prdt = palloc_get_page(PAL_ASSERT);
+        }
+        else {
+            c->bm_base = 0;
+            c->prdt = NULL;
+        }
         lock_init(&c->lock);
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
@@ -136,26 +211,77 @@ void ide_init (void) {
             d->channel = c;
             d->dev_no = dev_no;
             d->is_ata = false;
+            d->multiple = 1;
+            d->dma = false;
         }
 
         /* Register interrupt handler. */
         intr_register_ext(c->irq, interrupt_handler, c->name);
 
-        /* Reset hardware. */
-        reset_channel(c);
+        /* Probe the channel in its own thread, since resetting it takes
+           a good fraction of a second, mostly spent sleeping.  Without a
+           thread, probe it right here instead. */
+        c->ids = palloc_get_page(PAL_ASSERT);
+        sema_init(&c->probed, 0);
+        if (thread_create(c->name, PRI_DEFAULT, probe_channel, c) == TID_ERROR)
+            probe_channel(c);
+    }
 
-        /* Distinguish ATA hard disks from other devices. */
-        if (check_device_type(&c->devices[0]))
-            check_device_type(&c->devices[1]);
+    /* Register the disks found in channel order, so that device order
+       doesn't depend on which probe finished first. */
+    for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+        struct channel *c = &channels[chan_no];
+        int dev_no;
 
-        /* Read hard disk identity information. */
+        sema_down(&c->probed);
         for (dev_no = 0; dev_no < 2; dev_no++) {
             if (c->devices[dev_no].is_ata)
-                identify_ata_device(&c->devices[dev_no]);
+                register_ata_device(&c->devices[dev_no], c->ids[dev_no]);
         }
+        palloc_free_page(c->ids);
+        c->ids = NULL;
     }
 }
+
+/*! Resets channel C_, finds out which of its devices are ATA disks, and
+    reads their identity information into C_'s IDS. */
+static void probe_channel(void *c_) {
+    struct channel *c = c_;
+    int dev_no;
+
+    /* Reset hardware. */
+    reset_channel(c);
+
+    /* Distinguish ATA hard disks from other devices. */
+    if (check_device_type(&c->devices[0]))
+        check_device_type(&c->devices[1]);
+
+    /* Read hard disk identity information. */
+    for (dev_no = 0; dev_no < 2; dev_no++) {
+        if (c->devices[dev_no].is_ata)
+            identify_ata_device(&c->devices[dev_no], c->ids[dev_no]);
+    }
+
+    sema_up(&c->probed);
+}
 
+/*! Looks for a PCI IDE controller with a bus-master interface and enables
+    it for DMA.  Returns its bus master base port, or 0 if there is none. */
+static uint16_t find_bus_master(void) {
+    struct pci_device pci;
+    uint16_t bm_base;
+
+    /* Bit 7 of the programming interface says bus mastering is supported;
+       the bus master ports are then in BAR 4. */
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pci) ||
+        (pci.prog_if & 0x80) == 0)
+        return 0;
+    bm_base = pci_io_bar(&pci, 4);
+    if (bm_base != 0)
+        pci_enable_bus_master(&pci);
+    return bm_base;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string(char *, int size);
@@ -242,15 +368,10 @@ static bool check_device_type(struct ata_disk *d) {
     }
 }
 
-/*! Sends an IDENTIFY DEVICE command to disk D and reads the response.
-    Registers the disk with the block device layer. */
-static void identify_ata_device(struct ata_disk *d) {
+/*! Sends an IDENTIFY DEVICE command to disk D and reads the response
+    into ID, which must have room for BLOCK_SECTOR_SIZE bytes. */
+static void identify_ata_device(struct ata_disk *d, char *id) {
     struct channel *c = d->channel;
-    char id[BLOCK_SECTOR_SIZE];
-    block_sector_t capacity;
-    char *model, *serial;
-    char extra_info[128];
-    struct block *block;
 
     ASSERT(d->is_ata);
 
@@ -264,14 +385,29 @@ static void identify_ata_device(struct ata_disk *d) {
         d->is_ata = false;
         return;
     }
-    input_sector(c, id);
+    input_sectors(c, id, 1);
+
+    /* Transfer several sectors per interrupt if the disk allows it, and
+       use DMA if both the disk and the controller support it. */
+    enable_multiple_mode(d, (uint8_t) id[47 * 2]);
+    d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+}
+
+/*! Registers disk D, whose IDENTIFY DEVICE data is ID, with the block
+    device layer and scans it for partitions. */
+static void register_ata_device(struct ata_disk *d, char *id) {
+    block_sector_t capacity;
+    char *model, *serial;
+    char extra_info[128];
+    struct block *block;
 
     /* Calculate capacity.  Read model name and serial number. */
     capacity = *(uint32_t *) &id[60 * 2];
     model = descramble_ata_string(&id[10 * 2], 20);
     serial = descramble_ata_string(&id[27 * 2], 40);
     snprintf(extra_info, sizeof(extra_info),
-             "model \"%s\", serial \"%s\"", model, serial);
+             "model \"%s\", serial \"%s\"%s", model, serial,
+             d->dma ? ", DMA" : "");
 
     /* Disable access to IDE disks over 1 GB, which are likely physical IDE
        disks rather than virtual ones.  If we don't allow access to those,
@@ -291,6 +427,29 @@ static void identify_ata_device(struct ata_disk *d) {
     partition_scan(block);
 }
 
+/*! Asks disk D to transfer MAX_MULTIPLE sectors per interrupt under READ
+    MULTIPLE and WRITE MULTIPLE, as reported in word 47 of its IDENTIFY
+    DEVICE data.  Leaves D in single-sector mode if the disk doesn't support
+    it or refuses. */
+static void enable_multiple_mode(struct ata_disk *d, int max_multiple) {
+    struct channel *c = d->channel;
+    int multiple = 1;
+
+    /* SET MULTIPLE MODE only accepts powers of two. */
+    while (multiple * 2 <= max_multiple)
+        multiple *= 2;
+    if (multiple == 1)
+        return;
+
+    select_device_wait(d);
+    outb(reg_nsect(c), multiple);
+    issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+    sema_down(&c->completion_wait);
+    wait_while_busy(d);
+    if ((inb(reg_alt_status(c)) & STA_ERR) == 0)
+        d->multiple = multiple;
+}
+
 /*! Translates STRING, which consists of SIZE bytes in a funky format, into a
     null-terminated string in-place.  Drops trailing whitespace and null bytes.
     Returns STRING. */
@@ -315,53 +474,192 @@ static char * descramble_ata_string(char *string, int size) {
     return string;
 }
 
-/*! Reads sector SEC_NO from disk D into BUFFER, which must have room for
-    BLOCK_SECTOR_SIZE bytes.  Internally synchronizes accesses to disks,
-    so external per-disk locking is unneeded. */
-static void ide_read(void *d_, block_sector_t sec_no, void *buffer) {
+/*! Reads CNT sectors starting at SEC_NO from disk D into BUFFER, which
+    must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Each command moves up
+    to MAX_TRANSFER_SECTORS sectors.  Internally synchronizes accesses to
+    disks, so external per-disk locking is unneeded. */
+static void ide_read_multiple(void *d_, block_sector_t sec_no, size_t cnt,
+                              void *buffer) {
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
+    uint8_t *p = buffer;
     lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-    input_sector(c, buffer);
+    while (cnt > 0) {
+        size_t xfer = cnt < MAX_TRANSFER_SECTORS ? cnt : MAX_TRANSFER_SECTORS;
+        if (!d->dma || !dma_transfer(d, sec_no, xfer, p, false))
+            pio_read(d, sec_no, xfer, p);
+        p += xfer * BLOCK_SECTOR_SIZE;
+        sec_no += xfer;
+        cnt -= xfer;
+    }
     lock_release(&c->lock);
 }
 
+/*! Writes CNT sectors starting at SEC_NO to disk D from BUFFER, which must
+    contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+    acknowledged receiving all of the data.  Internally synchronizes
+    accesses to disks, so external per-disk locking is unneeded. */
+static void ide_write_multiple(void *d_, block_sector_t sec_no, size_t cnt,
+                               const void *buffer) {
+    struct ata_disk *d = d_;
+    struct channel *c = d->channel;
+    const uint8_t *p = buffer;
+    lock_acquire(&c->lock);
+    while (cnt > 0) {
+        size_t xfer = cnt < MAX_TRANSFER_SECTORS ? cnt : MAX_TRANSFER_SECTORS;
+        if (!d->dma || !dma_transfer(d, sec_no, xfer, p, true))
+            pio_write(d, sec_no, xfer, p);
+        p += xfer * BLOCK_SECTOR_SIZE;
+        sec_no += xfer;
+        cnt -= xfer;
+    }
+    lock_release(&c->lock);
+}
+
+/*! Reads sector SEC_NO from disk D into BUFFER, which must have room for
+    BLOCK_SECTOR_SIZE bytes.  Internally synchronizes accesses to disks,
+    so external per-disk locking is unneeded. */
+static void ide_read(void *d_, block_sector_t sec_no, void *buffer) {
+    ide_read_multiple(d_, sec_no, 1, buffer);
+}
+
 /*! Write sector SEC_NO to disk D from BUFFER, which must contain
     BLOCK_SECTOR_SIZE bytes.  Returns after the disk has acknowledged
     receiving the data.  Internally synchronizes accesses to disks, so external
     per-disk locking is unneeded. */
 static void ide_write(void *d_, block_sector_t sec_no, const void *buffer) {
-    struct ata_disk *d = d_;
-    struct channel *c = d->channel;
-    lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
-    lock_release(&c->lock);
+    ide_write_multiple(d_, sec_no, 1, buffer);
 }
 
 static struct block_operations ide_operations = {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
 };
 
+/*! Reads CNT sectors, at most MAX_TRANSFER_SECTORS, starting at SEC_NO from
+    disk D into BUFFER with programmed I/O, taking one interrupt per
+    D->multiple sectors.  D's channel must be locked. */
+static void pio_read(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                     void *buffer) {
+    struct channel *c = d->channel;
+    uint8_t *p = buffer;
+    size_t done;
+
+    select_sector(d, sec_no, cnt);
+    issue_pio_command(c, d->multiple > 1 ? CMD_READ_MULTIPLE
+                                         : CMD_READ_SECTOR_RETRY);
+    for (done = 0; done < cnt; ) {
+        size_t block = cnt - done < (size_t) d->multiple
+                       ? cnt - done : (size_t) d->multiple;
+        sema_down(&c->completion_wait);
+        if (!wait_while_busy(d))
+            PANIC("%s: disk read failed, sector=%"PRDSNu,
+                  d->name, sec_no + done);
+        input_sectors(c, p, block);
+        p += block * BLOCK_SECTOR_SIZE;
+        done += block;
+    }
+}
+
+/*! Writes CNT sectors, at most MAX_TRANSFER_SECTORS, starting at SEC_NO to
+    disk D from BUFFER with programmed I/O, taking one interrupt per
+    D->multiple sectors.  D's channel must be locked. */
+static void pio_write(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                      const void *buffer) {
+    struct channel *c = d->channel;
+    const uint8_t *p = buffer;
+    size_t done;
+
+    select_sector(d, sec_no, cnt);
+    issue_pio_command(c, d->multiple > 1 ? CMD_WRITE_MULTIPLE
+                                         : CMD_WRITE_SECTOR_RETRY);
+    for (done = 0; done < cnt; ) {
+        size_t block = cnt - done < (size_t) d->multiple
+                       ? cnt - done : (size_t) d->multiple;
+        if (!wait_while_busy(d))
+            PANIC("%s: disk write failed, sector=%"PRDSNu,
+                  d->name, sec_no + done);
+        output_sectors(c, p, block);
+        sema_down(&c->completion_wait);
+        p += block * BLOCK_SECTOR_SIZE;
+        done += block;
+    }
+}
+
+/*! Fills in channel C's PRD table to describe the SIZE bytes at BUFFER,
+    which must be in kernel memory.  Splitting at page boundaries keeps
+    every piece physically contiguous and clear of 64 kB boundaries. */
+static void build_prdt(struct channel *c, const void *buffer, size_t size) {
+    const uint8_t *p = buffer;
+    struct prd *prd = c->prdt;
+
+    ASSERT(size > 0);
+    ASSERT(is_kernel_vaddr(buffer));
+    while (size > 0) {
+        size_t chunk = PGSIZE - pg_ofs(p);
+        if (chunk > size)
+            chunk = size;
+        prd->addr = vtop(p);
+        prd->size = chunk;
+        prd->flags = 0;
+        prd++;
+        p += chunk;
+        size -= chunk;
+    }
+    prd[-1].flags = PRD_EOT;
+}
+
+/*! Transfers CNT sectors, at most MAX_TRANSFER_SECTORS, starting at SEC_NO
+    between disk D and BUFFER with bus-master DMA, writing to the disk if
+    WRITE is true.  The CPU is free for other threads until the disk
+    interrupts at the end.  D's channel must be locked.
+
+    Returns true if successful.  On failure, turns DMA off for D and returns
+    false, so that the caller can retry with programmed I/O. */
+static bool dma_transfer(struct ata_disk *d, block_sector_t sec_no,
+                         size_t cnt, const void *buffer, bool write) {
+    struct channel *c = d->channel;
+    uint8_t direction = write ? 0 : BM_CMD_READ;
+    uint8_t bm_status, status;
+
+    build_prdt(c, buffer, cnt * BLOCK_SECTOR_SIZE);
+    outl(reg_bm_prdt(c), vtop(c->prdt));
+    outb(reg_bm_command(c), direction);
+    outb(reg_bm_status(c), BM_STA_ERROR | BM_STA_INTR);
+
+    select_sector(d, sec_no, cnt);
+    issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+    outb(reg_bm_command(c), direction | BM_CMD_START);
+    sema_down(&c->completion_wait);
+
+    outb(reg_bm_command(c), direction);
+    bm_status = inb(reg_bm_status(c));
+    outb(reg_bm_status(c), BM_STA_ERROR | BM_STA_INTR);
+    status = inb(reg_alt_status(c));
+    if ((bm_status & (BM_STA_ERROR | BM_STA_ACTIVE)) || (status & STA_ERR)) {
+        printf("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+               d->name, write ? "write" : "read", sec_no);
+        d->dma = false;
+        return false;
+    }
+    return true;
+}
+
 /*! Selects device D, waiting for it to become ready, and then writes SEC_NO
-    to the disk's sector selection registers.  (We use LBA mode.) */
-static void select_sector(struct ata_disk *d, block_sector_t sec_no) {
+    and the sector count CNT to the disk's sector selection registers.  (We
+    use LBA mode.) */
+static void select_sector(struct ata_disk *d, block_sector_t sec_no,
+                          size_t cnt) {
     struct channel *c = d->channel;
 
-    ASSERT(sec_no < (1UL << 28));
+    ASSERT(sec_no + cnt <= (1UL << 28));
+    ASSERT(cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
   
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
+    outb(reg_nsect(c), cnt % MAX_TRANSFER_SECTORS);
     outb(reg_lbal(c), sec_no);
     outb(reg_lbam(c), sec_no >> 8);
     outb(reg_lbah(c), (sec_no >> 16));
@@ -380,16 +678,17 @@ static void issue_pio_command(struct channel *c, uint8_t command) {
     outb(reg_command(c), command);
 }
 
-/*! Reads a sector from channel C's data register in PIO mode into
-    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
-static void input_sector(struct channel *c, void *sector) {
-    insw(reg_data(c), sector, BLOCK_SECTOR_SIZE / 2);
+/*! Reads CNT sectors from channel C's data register in PIO mode into
+    SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void input_sectors(struct channel *c, void *sectors, size_t cnt) {
+    insw(reg_data(c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/*! Writes SECTOR to channel C's data register in PIO mode.
-    SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
-static void output_sector(struct channel *c, const void *sector) {
-    outsw(reg_data(c), sector, BLOCK_SECTOR_SIZE / 2);
+/*! Writes CNT sectors from SECTORS to channel C's data register in PIO
+    mode.  SECTORS must contain CNT * BLOCK_SECTOR_SIZE bytes. */
+static void output_sectors(struct channel *c, const void *sectors,
+                           size_t cnt) {
+    outsw(reg_data(c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
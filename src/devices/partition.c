@@ -166,7 +166,9 @@ static void found_partition(struct block *block, uint8_t part_type,
         snprintf(name, sizeof name, "%s%d", block_name(block), part_nr);
         snprintf(extra_info, sizeof extra_info, "%s (%02x)",
                  partition_type_name(part_type), part_type);
-        block_register(name, type, extra_info, size, &partition_operations, p);
+        block_set_parent(block_register(name, type, extra_info, size,
+                                        &partition_operations, p),
+                         block, start);
     }
 }
 
@@ -296,8 +298,25 @@ static void partition_write(void *p_, block_sector_t sector,
     block_write(p->block, p->start + sector, buffer);
 }
 
+/*! Reads CNT sectors starting at SECTOR from partition P into BUFFER. */
+static void partition_read_multiple(void *p_, block_sector_t sector,
+                                    size_t cnt, void *buffer) {
+    struct partition *p = p_;
+    block_read_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
+/*! Writes CNT sectors starting at SECTOR to partition P from BUFFER. */
+static void partition_write_multiple(void *p_, block_sector_t sector,
+                                     size_t cnt, const void *buffer) {
+    struct partition *p = p_;
+    block_write_multiple(p->block, p->start + sector, cnt, buffer);
+}
+
 static struct block_operations partition_operations = {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multiple,
+    partition_write_multiple,
+    NULL
 };
 
@@ -0,0 +1,154 @@
+/*! \file pci.c
+ *
+ * Enumeration of, and configuration space access to, PCI devices through
+ * configuration mechanism #1 (I/O ports 0xcf8 and 0xcfc).  See [PCI] for
+ * details.
+ */
+
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/*! Configuration mechanism #1 ports. @{ */
+#define PCI_CONFIG_ADDRESS 0xcf8        /*!< Selects a register (w/o). */
+#define PCI_CONFIG_DATA 0xcfc           /*!< Selected register data. */
+#define PCI_CONFIG_ENABLE 0x80000000    /*!< Enable bit for the address. */
+/*! @} */
+
+/*! Configuration space registers. @{ */
+#define REG_ID 0x00             /*!< Device ID 31:16, vendor ID 15:0. */
+#define REG_COMMAND 0x04        /*!< Status 31:16, command 15:0. */
+#define REG_CLASS 0x08          /*!< Class 31:24, subclass 23:16, prog IF 15:8. */
+#define REG_HEADER 0x0c         /*!< Header type 23:16. */
+#define REG_BAR0 0x10           /*!< First base address register. */
+#define REG_BUSES 0x18          /*!< Bridges: secondary bus 15:8. */
+#define REG_INTERRUPT 0x3c      /*!< Interrupt line 7:0. */
+/*! @} */
+
+#define CMD_BUS_MASTER 0x0004   /*!< Command register: bus master enable. */
+#define HEADER_MULTIFUNCTION 0x80       /*!< Header type: multifunction. */
+#define BAR_IO 0x1              /*!< BAR is in I/O space. */
+
+#define DEV_CNT 32              /*!< Devices per bus. */
+#define FUNC_CNT 8              /*!< Functions per device. */
+
+static uint32_t read_config(uint8_t bus, uint8_t dev, uint8_t func,
+                            uint8_t reg);
+static void scan_bus(uint8_t bus, pci_found_func *, void *aux);
+
+/*! Calls FOUND, passing AUX, for every function on every bus reachable
+    from bus 0 through PCI-to-PCI bridges. */
+void pci_scan(pci_found_func *found, void *aux) {
+    scan_bus(0, found, aux);
+}
+
+/*! Scans every device on BUS. */
+static void scan_bus(uint8_t bus, pci_found_func *found, void *aux) {
+    uint8_t dev, func;
+
+    for (dev = 0; dev < DEV_CNT; dev++) {
+        for (func = 0; func < FUNC_CNT; func++) {
+            uint32_t id = read_config(bus, dev, func, REG_ID);
+            uint32_t class = read_config(bus, dev, func, REG_CLASS);
+            struct pci_device d;
+
+            if ((id & 0xffff) == 0xffff) {
+                /* No function here.  A missing function 0 means no
+                   device at all. */
+                if (func == 0)
+                    break;
+                continue;
+            }
+
+            d.bus = bus;
+            d.dev = dev;
+            d.func = func;
+            d.vendor_id = id & 0xffff;
+            d.device_id = id >> 16;
+            d.class = class >> 24;
+            d.subclass = class >> 16;
+            d.prog_if = class >> 8;
+            d.irq = read_config(bus, dev, func, REG_INTERRUPT);
+            found(&d, aux);
+
+            if (d.class == PCI_CLASS_BRIDGE &&
+                d.subclass == PCI_SUBCLASS_PCI_BRIDGE) {
+                uint8_t secondary = read_config(bus, dev, func, REG_BUSES) >> 8;
+                if (secondary > bus)
+                    scan_bus(secondary, found, aux);
+            }
+
+            if (func == 0 &&
+                !(read_config(bus, dev, 0, REG_HEADER) >> 16
+                  & HEADER_MULTIFUNCTION))
+                break;
+        }
+    }
+}
+
+/*! Search state for pci_find_class(). */
+struct class_search {
+    uint8_t class, subclass;    /*!< What we want. */
+    struct pci_device *result;  /*!< Where to put it. */
+    bool found;                 /*!< Found one yet? */
+};
+
+static void match_class(const struct pci_device *d, void *search_) {
+    struct class_search *search = search_;
+    if (!search->found && d->class == search->class &&
+        d->subclass == search->subclass) {
+        *search->result = *d;
+        search->found = true;
+    }
+}
+
+/*! Finds the first function with the given CLASS and SUBCLASS and stores
+    it in *D.  Returns true if successful, false if there is none. */
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_device *d) {
+    struct class_search search = { class, subclass, d, false };
+    pci_scan(match_class, &search);
+    return search.found;
+}
+
+/*! Reads the 32-bit configuration register REG, which must be a multiple
+    of 4, of device D. */
+uint32_t pci_read_config(const struct pci_device *d, uint8_t reg) {
+    return read_config(d->bus, d->dev, d->func, reg);
+}
+
+/*! Writes VALUE to the 32-bit configuration register REG, which must be a
+    multiple of 4, of device D. */
+void pci_write_config(const struct pci_device *d, uint8_t reg,
+                      uint32_t value) {
+    ASSERT(reg % 4 == 0);
+    outl(PCI_CONFIG_ADDRESS, PCI_CONFIG_ENABLE | (d->bus << 16)
+         | (d->dev << 11) | (d->func << 8) | reg);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/*! Returns the I/O port base of D's base address register BAR (0...5), or
+    0 if that BAR is unused or maps memory rather than I/O ports. */
+uint16_t pci_io_bar(const struct pci_device *d, int bar) {
+    uint32_t value;
+
+    ASSERT(bar >= 0 && bar < 6);
+    value = pci_read_config(d, REG_BAR0 + bar * 4);
+    return (value & BAR_IO) ? (value & ~3u) : 0;
+}
+
+/*! Allows D to initiate DMA transfers. */
+void pci_enable_bus_master(const struct pci_device *d) {
+    uint32_t command = pci_read_config(d, REG_COMMAND);
+    /* Only touch the command half; writing 1s to the status half would
+       clear its sticky bits. */
+    pci_write_config(d, REG_COMMAND, (command & 0xffff) | CMD_BUS_MASTER);
+}
+
+/*! Reads configuration register REG of BUS:DEV.FUNC. */
+static uint32_t read_config(uint8_t bus, uint8_t dev, uint8_t func,
+                            uint8_t reg) {
+    ASSERT(reg % 4 == 0);
+    outl(PCI_CONFIG_ADDRESS, PCI_CONFIG_ENABLE | (bus << 16) | (dev << 11)
+         | (func << 8) | reg);
+    return inl(PCI_CONFIG_DATA);
+}
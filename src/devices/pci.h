@@ -0,0 +1,38 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! A PCI function, as found by pci_scan(). */
+struct pci_device {
+    uint8_t bus;                /*!< Bus number. */
+    uint8_t dev;                /*!< Device number on the bus. */
+    uint8_t func;               /*!< Function number within the device. */
+    uint16_t vendor_id;         /*!< Vendor ID. */
+    uint16_t device_id;         /*!< Device ID. */
+    uint8_t class;              /*!< Base class code. */
+    uint8_t subclass;           /*!< Subclass code. */
+    uint8_t prog_if;            /*!< Programming interface. */
+    uint8_t irq;                /*!< Interrupt line, as wired by the BIOS. */
+};
+
+/*! PCI class codes of interest. @{ */
+#define PCI_CLASS_STORAGE 0x01          /*!< Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /*!< IDE controller. */
+#define PCI_CLASS_BRIDGE 0x06           /*!< Bridge. */
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04    /*!< PCI-to-PCI bridge. */
+/*! @} */
+
+/*! Called by pci_scan() for each function found. */
+typedef void pci_found_func(const struct pci_device *, void *aux);
+
+void pci_scan(pci_found_func *, void *aux);
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_device *);
+
+uint32_t pci_read_config(const struct pci_device *, uint8_t reg);
+void pci_write_config(const struct pci_device *, uint8_t reg, uint32_t);
+uint16_t pci_io_bar(const struct pci_device *, int bar);
+void pci_enable_bus_master(const struct pci_device *);
+
+#endif /* devices/pci.h */
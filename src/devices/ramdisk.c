@@ -0,0 +1,150 @@
+/*! \file ramdisk.c
+
+   A block device kept in kernel memory.  It has next to no latency, so
+   file system and swap code run on it shows its own overhead rather than
+   that of disk emulation.  RAM disks are requested on the kernel command
+   line with "-ramdisk=ROLE:KB", e.g. "-ramdisk=swap:2048", and are
+   registered before any disks, so that they take that role by default.
+   Their contents start out zeroed and are lost at power off. */
+
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/*! Sectors per page of RAM disk memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/*! Most RAM disks that may be requested. */
+#define MAX_RAMDISKS 4
+
+/*! A RAM disk. */
+struct ramdisk {
+    char name[8];               /*!< Name, e.g. "rd0". */
+    enum block_type role;       /*!< Role to register it under. */
+    size_t page_cnt;            /*!< Size in pages. */
+    uint8_t **pages;            /*!< PAGE_CNT pages, not contiguous. */
+};
+
+static struct ramdisk ramdisks[MAX_RAMDISKS];
+static size_t ramdisk_cnt;
+
+static struct block_operations ramdisk_operations;
+
+/*! Records a request, from the kernel command line, for a RAM disk as
+    described by SPEC, which has the form ROLE:KB.  The RAM disk is created
+    later, by ramdisk_init(). */
+void ramdisk_configure(char *spec) {
+    struct ramdisk *rd;
+    char *save_ptr;
+    char *role_name = spec != NULL ? strtok_r(spec, ":", &save_ptr) : NULL;
+    char *size = role_name != NULL ? strtok_r(NULL, "", &save_ptr) : NULL;
+    int kb = size != NULL ? atoi(size) : 0;
+    enum block_type role;
+
+    if (kb <= 0)
+        PANIC("-ramdisk wants ROLE:KB, e.g. -ramdisk=swap:2048");
+    for (role = 0; role < BLOCK_ROLE_CNT; role++)
+        if (!strcmp(role_name, block_type_name(role)))
+            break;
+    if (role == BLOCK_ROLE_CNT || role == BLOCK_KERNEL)
+        PANIC("-ramdisk: unknown role `%s'", role_name);
+    if (ramdisk_cnt >= MAX_RAMDISKS)
+        PANIC("-ramdisk: at most %d RAM disks", MAX_RAMDISKS);
+
+    rd = &ramdisks[ramdisk_cnt];
+    snprintf(rd->name, sizeof rd->name, "rd%zu", ramdisk_cnt);
+    rd->role = role;
+    rd->page_cnt = DIV_ROUND_UP((size_t) kb * 1024, PGSIZE);
+    ramdisk_cnt++;
+}
+
+/*! Allocates and registers the RAM disks requested on the command line.
+    Memory comes from the kernel pool one page at a time, so fragmentation
+    doesn't matter. */
+void ramdisk_init(void) {
+    size_t i, j;
+
+    for (i = 0; i < ramdisk_cnt; i++) {
+        struct ramdisk *rd = &ramdisks[i];
+
+        rd->pages = malloc(rd->page_cnt * sizeof *rd->pages);
+        if (rd->pages == NULL)
+            PANIC("%s: out of memory", rd->name);
+        for (j = 0; j < rd->page_cnt; j++) {
+            rd->pages[j] = palloc_get_page(PAL_ZERO);
+            if (rd->pages[j] == NULL)
+                PANIC("%s: out of memory after %zu of %zu kB", rd->name,
+                      j * PGSIZE / 1024, rd->page_cnt * PGSIZE / 1024);
+        }
+
+        block_register(rd->name, rd->role, "RAM disk",
+                       rd->page_cnt * SECTORS_PER_PAGE,
+                       &ramdisk_operations, rd);
+    }
+}
+
+/*! Returns the address of sector SEC_NO of RAM disk RD. */
+static uint8_t *sector_address(struct ramdisk *rd, block_sector_t sec_no) {
+    return rd->pages[sec_no / SECTORS_PER_PAGE]
+           + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/*! Reads sector SEC_NO from RAM disk RD_ into BUFFER. */
+static void ramdisk_read(void *rd_, block_sector_t sec_no, void *buffer) {
+    memcpy(buffer, sector_address(rd_, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/*! Writes sector SEC_NO to RAM disk RD_ from BUFFER. */
+static void ramdisk_write(void *rd_, block_sector_t sec_no,
+                          const void *buffer) {
+    memcpy(sector_address(rd_, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/*! Reads CNT sectors starting at SEC_NO from RAM disk RD_ into BUFFER,
+    a page's worth at a time. */
+static void ramdisk_read_multiple(void *rd_, block_sector_t sec_no,
+                                  size_t cnt, void *buffer) {
+    uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t run = SECTORS_PER_PAGE - sec_no % SECTORS_PER_PAGE;
+        if (run > cnt)
+            run = cnt;
+        memcpy(p, sector_address(rd_, sec_no), run * BLOCK_SECTOR_SIZE);
+        p += run * BLOCK_SECTOR_SIZE;
+        sec_no += run;
+        cnt -= run;
+    }
+}
+
+/*! Writes CNT sectors starting at SEC_NO to RAM disk RD_ from BUFFER, a
+    page's worth at a time. */
+static void ramdisk_write_multiple(void *rd_, block_sector_t sec_no,
+                                   size_t cnt, const void *buffer) {
+    const uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t run = SECTORS_PER_PAGE - sec_no % SECTORS_PER_PAGE;
+        if (run > cnt)
+            run = cnt;
+        memcpy(sector_address(rd_, sec_no), p, run * BLOCK_SECTOR_SIZE);
+        p += run * BLOCK_SECTOR_SIZE;
+        sec_no += run;
+        cnt -= run;
+    }
+}
+
+static struct block_operations ramdisk_operations = {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL
+};
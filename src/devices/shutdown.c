@@ -13,6 +13,12 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/cow.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/text.h"
+#endif
 
 /*! Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -114,5 +120,11 @@ static void print_stats(void) {
 #ifdef USERPROG
     exception_print_stats();
 #endif
+#ifdef VM
+    frametable_print_stats();
+    swap_print_stats();
+    textcache_print_stats();
+    cow_print_stats();
+#endif
 }
 
@@ -0,0 +1,289 @@
+/*! \file stripe.c
+
+   A block device whose sectors are spread round-robin, a chunk at a time,
+   across several member devices, like RAID 0.  Chunk I of the stripe is
+   chunk I / N of member I % N, for N members.  Each member keeps its own
+   request queue and I/O thread, so a transfer that spans several chunks
+   keeps disks on different IDE channels (or virtio disks) busy at once.
+
+   Stripes are requested on the kernel command line with
+   "-stripe=ROLE:DEV,DEV[,...][:CHUNK]", e.g. "-stripe=swap:hdb,hdd", and
+   are registered as "md0", "md1", and so on.  A stripe takes ROLE ahead
+   of any device of that type found by scanning, unless another device is
+   named for ROLE explicitly.  Its members should not be used for anything
+   else. */
+
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/*! Most stripes that may be requested. */
+#define MAX_STRIPES 2
+
+/*! Most members of one stripe. */
+#define MAX_MEMBERS 4
+
+/*! Default chunk size in sectors: one page. */
+#define DEFAULT_CHUNK 8
+
+/*! Most transfers started on a stripe at once.  Matches the depth the
+    block layer keeps in flight on a driver with a START operation. */
+#define STRIPE_DEPTH 8
+
+/*! A transfer in progress on a stripe, split into one request per chunk
+    it touches. */
+struct stripe_io {
+    bool busy;                          /*!< In use? */
+    int pending;                        /*!< Pieces not yet complete. */
+    block_done_func *done;              /*!< Called when all are done. */
+    void *done_aux;                     /*!< Passed to DONE. */
+    struct semaphore *free;             /*!< Stripe's count of idle I/Os. */
+    struct block_request pieces[BLOCK_MAX_MERGE_SECTORS]; /*!< Pieces. */
+};
+
+/*! A stripe. */
+struct stripe {
+    char name[8];                       /*!< Name, e.g. "md0". */
+    enum block_type role;               /*!< Role to take. */
+    const char *member_names[MAX_MEMBERS]; /*!< Members, as requested. */
+    struct block *members[MAX_MEMBERS]; /*!< Member devices. */
+    size_t member_cnt;                  /*!< Number of members. */
+    block_sector_t chunk;               /*!< Sectors per chunk. */
+
+    struct stripe_io *ios;              /*!< STRIPE_DEPTH transfers. */
+    struct semaphore free_ios;          /*!< Number of idle IOS. */
+};
+
+static struct stripe stripes[MAX_STRIPES];
+static size_t stripe_cnt;
+
+static struct block_operations stripe_operations;
+
+/*! Records a request, from the kernel command line, for a stripe as
+    described by SPEC, which has the form ROLE:DEV,DEV[,...][:CHUNK].  The
+    stripe is put together later, by stripe_init(), once its members have
+    been found.  SPEC must stay valid until then. */
+void stripe_configure(char *spec) {
+    struct stripe *sd;
+    char *save_ptr, *member_ptr, *member;
+    char *role_name = spec != NULL ? strtok_r(spec, ":", &save_ptr) : NULL;
+    char *members = role_name != NULL ? strtok_r(NULL, ":", &save_ptr) : NULL;
+    char *chunk = members != NULL ? strtok_r(NULL, "", &save_ptr) : NULL;
+    enum block_type role;
+
+    if (members == NULL)
+        PANIC("-stripe wants ROLE:DEV,DEV[,...][:CHUNK], "
+              "e.g. -stripe=swap:hdb,hdd");
+    for (role = 0; role < BLOCK_ROLE_CNT; role++)
+        if (!strcmp(role_name, block_type_name(role)))
+            break;
+    if (role == BLOCK_ROLE_CNT || role == BLOCK_KERNEL)
+        PANIC("-stripe: unknown role `%s'", role_name);
+    if (stripe_cnt >= MAX_STRIPES)
+        PANIC("-stripe: at most %d stripes", MAX_STRIPES);
+
+    sd = &stripes[stripe_cnt];
+    snprintf(sd->name, sizeof sd->name, "md%zu", stripe_cnt);
+    sd->role = role;
+    sd->member_cnt = 0;
+    for (member = strtok_r(members, ",", &member_ptr); member != NULL;
+         member = strtok_r(NULL, ",", &member_ptr)) {
+        if (sd->member_cnt >= MAX_MEMBERS)
+            PANIC("-stripe: at most %d members", MAX_MEMBERS);
+        sd->member_names[sd->member_cnt++] = member;
+    }
+    if (sd->member_cnt < 2)
+        PANIC("-stripe: need at least 2 members");
+
+    sd->chunk = chunk != NULL ? atoi(chunk) : DEFAULT_CHUNK;
+    if (sd->chunk < 1 || sd->chunk > BLOCK_MAX_MERGE_SECTORS)
+        PANIC("-stripe: chunk must be 1 to %d sectors",
+              BLOCK_MAX_MERGE_SECTORS);
+    stripe_cnt++;
+}
+
+/*! Puts together and registers the stripes requested on the command line.
+    Must be called after the member devices have been registered.  Each
+    member contributes as many whole chunks as the smallest one has. */
+void stripe_init(void) {
+    size_t i, j, k;
+
+    for (i = 0; i < stripe_cnt; i++) {
+        struct stripe *sd = &stripes[i];
+        block_sector_t member_size = (block_sector_t) -1;
+        char extra_info[64];
+        struct block *block;
+        int ofs;
+
+        ofs = snprintf(extra_info, sizeof extra_info, "stripe of");
+        for (j = 0; j < sd->member_cnt; j++) {
+            struct block *m = block_get_by_name(sd->member_names[j]);
+            if (m == NULL)
+                PANIC("%s: no such block device \"%s\"",
+                      sd->name, sd->member_names[j]);
+            if (block_type(m) == BLOCK_KERNEL
+                || block_type(m) == BLOCK_FOREIGN)
+                PANIC("%s: %s is a %s partition", sd->name,
+                      sd->member_names[j], block_type_name(block_type(m)));
+            for (k = 0; k < j; k++)
+                if (sd->members[k] == m)
+                    PANIC("%s: %s named twice", sd->name, block_name(m));
+
+            sd->members[j] = m;
+            if (block_size(m) < member_size)
+                member_size = block_size(m);
+            ofs += snprintf(extra_info + ofs, sizeof extra_info - ofs,
+                            " %s", block_name(m));
+        }
+        member_size -= member_size % sd->chunk;
+        if (member_size == 0)
+            PANIC("%s: members smaller than a chunk", sd->name);
+
+        sd->ios = calloc(STRIPE_DEPTH, sizeof *sd->ios);
+        if (sd->ios == NULL)
+            PANIC("%s: out of memory", sd->name);
+        for (j = 0; j < STRIPE_DEPTH; j++)
+            sd->ios[j].free = &sd->free_ios;
+        sema_init(&sd->free_ios, STRIPE_DEPTH);
+
+        block = block_register(sd->name, sd->role, extra_info,
+                               member_size * sd->member_cnt,
+                               &stripe_operations, sd);
+        block_set_role(sd->role, block);
+    }
+}
+
+/*! Drops one of IO's pending counts, finishing IO if it was the last. */
+static void release_io(struct stripe_io *io) {
+    enum intr_level old_level = intr_disable();
+
+    if (--io->pending == 0) {
+        io->busy = false;
+        io->done(io->done_aux);
+        sema_up(io->free);
+    }
+    intr_set_level(old_level);
+}
+
+/*! Completion function for the pieces of a stripe_io. */
+static void piece_done(struct block_request *r) {
+    release_io(r->aux);
+}
+
+/*! Begins transferring CNT sectors, at most BLOCK_MAX_MERGE_SECTORS,
+    starting at SEC_NO between stripe SD_ and BUFFER, and returns without
+    waiting.  Submits one request per chunk to the member holding it, then
+    calls DONE(DONE_AUX) once all of them have completed. */
+static void stripe_start(void *sd_, block_sector_t sec_no, size_t cnt,
+                         void *buffer, bool write, block_done_func *done,
+                         void *done_aux) {
+    struct stripe *sd = sd_;
+    struct stripe_io *io;
+    enum intr_level old_level;
+    uint8_t *p = buffer;
+    size_t i;
+
+    ASSERT(cnt <= BLOCK_MAX_MERGE_SECTORS);
+
+    sema_down(&sd->free_ios);
+    old_level = intr_disable();
+    for (io = sd->ios; io->busy; io++)
+        ASSERT(io < sd->ios + STRIPE_DEPTH - 1);
+    io->busy = true;
+    intr_set_level(old_level);
+
+    /* Hold one extra count until every piece has been submitted, so that
+       early completions can't finish the transfer. */
+    io->done = done;
+    io->done_aux = done_aux;
+    io->pending = 1;
+
+    for (i = 0; cnt > 0; i++) {
+        struct block_request *r = &io->pieces[i];
+        block_sector_t chunk = sec_no / sd->chunk;
+        block_sector_t ofs = sec_no % sd->chunk;
+        size_t xfer = sd->chunk - ofs < cnt ? sd->chunk - ofs : cnt;
+
+        r->sector = chunk / sd->member_cnt * sd->chunk + ofs;
+        r->cnt = xfer;
+        r->buffer = p;
+        r->write = write;
+        r->complete = piece_done;
+        r->aux = io;
+
+        old_level = intr_disable();
+        io->pending++;
+        intr_set_level(old_level);
+        block_submit(sd->members[chunk % sd->member_cnt], r);
+
+        p += xfer * BLOCK_SECTOR_SIZE;
+        sec_no += xfer;
+        cnt -= xfer;
+    }
+
+    release_io(io);
+}
+
+/*! Completion function for stripe_transfer(). */
+static void wake_waiter(void *sema) {
+    sema_up(sema);
+}
+
+/*! Transfers CNT sectors starting at SEC_NO between stripe SD_ and BUFFER,
+    in pieces of at most BLOCK_MAX_MERGE_SECTORS sectors, and waits for
+    the transfer to finish. */
+static void stripe_transfer(void *sd_, block_sector_t sec_no, size_t cnt,
+                            void *buffer, bool write) {
+    uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t xfer = cnt < BLOCK_MAX_MERGE_SECTORS
+                      ? cnt : BLOCK_MAX_MERGE_SECTORS;
+        struct semaphore done;
+
+        sema_init(&done, 0);
+        stripe_start(sd_, sec_no, xfer, p, write, wake_waiter, &done);
+        sema_down(&done);
+
+        p += xfer * BLOCK_SECTOR_SIZE;
+        sec_no += xfer;
+        cnt -= xfer;
+    }
+}
+
+/*! Reads CNT sectors starting at SEC_NO from stripe SD_ into BUFFER. */
+static void stripe_read_multiple(void *sd_, block_sector_t sec_no,
+                                 size_t cnt, void *buffer) {
+    stripe_transfer(sd_, sec_no, cnt, buffer, false);
+}
+
+/*! Writes CNT sectors starting at SEC_NO to stripe SD_ from BUFFER. */
+static void stripe_write_multiple(void *sd_, block_sector_t sec_no,
+                                  size_t cnt, const void *buffer) {
+    stripe_transfer(sd_, sec_no, cnt, (void *) buffer, true);
+}
+
+/*! Reads sector SEC_NO from stripe SD_ into BUFFER. */
+static void stripe_read(void *sd_, block_sector_t sec_no, void *buffer) {
+    stripe_transfer(sd_, sec_no, 1, buffer, false);
+}
+
+/*! Writes sector SEC_NO to stripe SD_ from BUFFER. */
+static void stripe_write(void *sd_, block_sector_t sec_no,
+                         const void *buffer) {
+    stripe_transfer(sd_, sec_no, 1, (void *) buffer, true);
+}
+
+static struct block_operations stripe_operations = {
+    stripe_read,
+    stripe_write,
+    stripe_read_multiple,
+    stripe_write_multiple,
+    stripe_start
+};
@@ -0,0 +1,7 @@
+#ifndef DEVICES_STRIPE_H
+#define DEVICES_STRIPE_H
+
+void stripe_configure(char *spec);
+void stripe_init(void);
+
+#endif /* devices/stripe.h */
@@ -26,8 +26,10 @@ static int64_t ticks;
 /*! Number of loops per timer tick.  Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/*! Loops run between looks at the tick count during calibration. */
+#define CALIBRATION_STEP 1024
+
 static intr_handler_func timer_interrupt;
-static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
@@ -39,31 +41,74 @@ void timer_init(void) {
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
-/*! Calibrates loops_per_tick, used to implement brief delays. */
+/*! Number of loops per timer tick given on the command line, or 0 to
+    calibrate. */
+static unsigned configured_loops_per_tick;
+
+/*! TSC cycles per second, as measured by timer_calibrate(), or 0. */
+static uint64_t cycles_per_second;
+
+/*! Makes timer_calibrate() use LOOPS_PER_SECOND, a decimal number as
+    printed by an earlier calibration on the same machine, commas and all,
+    instead of measuring it. */
+void timer_configure_calibration(const char *loops_per_second) {
+    uint64_t loops = 0;
+    const char *p;
+
+    for (p = loops_per_second; p != NULL && *p != '\0'; p++) {
+        if (*p >= '0' && *p <= '9')
+            loops = loops * 10 + (*p - '0');
+        else if (*p != ',')
+            PANIC("-loops: bad number `%s'", loops_per_second);
+    }
+    if (loops / TIMER_FREQ == 0 || loops / TIMER_FREQ > UINT32_MAX)
+        PANIC("-loops: out of range");
+    configured_loops_per_tick = loops / TIMER_FREQ;
+}
+
+/*! Calibrates loops_per_tick, used to implement brief delays.  Counts how
+    many loops fit into a single timer tick, a CALIBRATION_STEP at a time,
+    which takes about two ticks instead of the couple of dozen a search by
+    bits would.  Measures the TSC rate over the same tick. */
 void timer_calibrate(void) {
-    unsigned high_bit, test_bit;
+    int64_t start;
+    uint64_t start_cycles;
+    unsigned loops;
 
     ASSERT(intr_get_level() == INTR_ON);
+    if (configured_loops_per_tick != 0) {
+        loops_per_tick = configured_loops_per_tick;
+        printf("Using %'"PRIu64" loops/s.\n",
+               (uint64_t) loops_per_tick * TIMER_FREQ);
+        return;
+    }
     printf("Calibrating timer...  ");
 
-    /* Approximate loops_per_tick as the largest power-of-two
-       still less than one timer tick. */
-    loops_per_tick = 1u << 10;
-    while (!too_many_loops (loops_per_tick << 1)) {
-        loops_per_tick <<= 1;
-        ASSERT(loops_per_tick != 0);
-    }
+    /* Wait for a timer tick. */
+    start = ticks;
+    while (ticks == start)
+        barrier();
 
-    /* Refine the next 8 bits of loops_per_tick. */
-    high_bit = loops_per_tick;
-    for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1) {
-        if (!too_many_loops(high_bit | test_bit))
-            loops_per_tick |= test_bit;
+    /* Count loops until the next one. */
+    start = ticks;
+    start_cycles = timer_cycles();
+    for (loops = 0; ticks == start; loops += CALIBRATION_STEP) {
+        busy_wait(CALIBRATION_STEP);
+        barrier();
     }
+    cycles_per_second = (timer_cycles() - start_cycles) * TIMER_FREQ;
 
+    loops_per_tick = loops > CALIBRATION_STEP ? loops - CALIBRATION_STEP
+                                              : CALIBRATION_STEP;
     printf("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
 }
 
+/*! Returns the number of TSC cycles per second measured by
+    timer_calibrate(), or 0 if calibration was skipped. */
+uint64_t timer_cycles_per_second(void) {
+    return cycles_per_second;
+}
+
 /*! Returns the number of timer ticks since the OS booted. */
 int64_t timer_ticks(void) {
     enum intr_level old_level = intr_disable();
@@ -188,23 +233,6 @@ static void timer_interrupt(struct intr_frame *args UNUSED) {
     thread_tick();
 }
 
-/*! Returns true if LOOPS iterations waits for more than one timer tick,
-    otherwise false. */
-static bool too_many_loops(unsigned loops) {
-    /* Wait for a timer tick. */
-    int64_t start = ticks;
-    while (ticks == start)
-        barrier();
-
-    /* Run LOOPS loops. */
-    start = ticks;
-    busy_wait(loops);
-
-    /* If the tick count changed, we iterated too long. */
-    barrier();
-    return start != ticks;
-}
-
 /*! Iterates through a simple loop LOOPS times, for implementing brief delays.
 
     Marked NO_INLINE because code alignment can significantly affect timings,
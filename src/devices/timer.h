@@ -8,7 +8,9 @@
 #define TIMER_FREQ 100
 
 void timer_init(void);
+void timer_configure_calibration(const char *loops_per_second);
 void timer_calibrate(void);
+uint64_t timer_cycles_per_second(void);
 
 int64_t timer_ticks(void);
 int64_t timer_elapsed(int64_t);
@@ -26,5 +28,13 @@ void timer_ndelay(int64_t nanoseconds);
 
 void timer_print_stats(void);
 
+/*! Returns the processor's time-stamp counter, which counts CPU cycles.
+    Finer grained than timer ticks, for measuring short intervals. */
+static inline uint64_t timer_cycles(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
 #endif /* devices/timer.h */
 
@@ -0,0 +1,419 @@
+/*! \file virtio-blk.c
+
+   A driver for virtio block devices attached over PCI, as QEMU provides
+   with "-drive if=virtio".  It uses the legacy (virtio 0.9.5) I/O port
+   interface and a single virtqueue, and keeps several requests in flight
+   on that queue at once.  See [Virtio] for details. */
+
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! PCI IDs of a legacy virtio block device. @{ */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+/*! @} */
+
+/*! Legacy virtio registers, relative to the device's I/O port base. @{ */
+#define reg_device_features(D) ((D)->io_base + 0x00) /*!< 32 bits (r/o). */
+#define reg_guest_features(D) ((D)->io_base + 0x04)  /*!< 32 bits. */
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)       /*!< 32 bits. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)      /*!< 16 bits (r/o). */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)    /*!< 16 bits. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)    /*!< 16 bits. */
+#define reg_status(D) ((D)->io_base + 0x12)          /*!< 8 bits. */
+#define reg_isr(D) ((D)->io_base + 0x13)             /*!< 8 bits (r/o). */
+#define reg_capacity(D) ((D)->io_base + 0x14)        /*!< 64 bits (r/o). */
+/*! @} */
+
+/*! Device status bits. @{ */
+#define STATUS_ACKNOWLEDGE 0x01         /*!< Guest has noticed the device. */
+#define STATUS_DRIVER 0x02              /*!< Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04           /*!< Driver is ready. */
+#define STATUS_FAILED 0x80              /*!< Guest has given up on it. */
+/*! @} */
+
+/*! Virtqueue descriptor flags. @{ */
+#define DESC_NEXT 0x01                  /*!< NEXT field is valid. */
+#define DESC_WRITE 0x02                 /*!< Device writes, not reads. */
+/*! @} */
+
+/*! Block request types and status. @{ */
+#define REQ_IN 0                        /*!< Read from the device. */
+#define REQ_OUT 1                       /*!< Write to the device. */
+#define REQ_OK 0                        /*!< Success status. */
+/*! @} */
+
+/*! Legacy virtqueues are aligned to this boundary. */
+#define QUEUE_ALIGN 4096
+
+/*! Most physically contiguous pieces a transfer of
+    BLOCK_MAX_MERGE_SECTORS sectors can span. */
+#define MAX_SEGMENTS (BLOCK_MAX_MERGE_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE + 1)
+
+/*! Descriptors used by one request: header, data pieces, status. */
+#define DESCS_PER_REQUEST (MAX_SEGMENTS + 2)
+
+/*! Most requests in flight on one device. */
+#define MAX_REQUESTS 32
+
+/*! Most virtio block devices we drive. */
+#define MAX_DISKS 4
+
+/*! A virtqueue descriptor. */
+struct vring_desc {
+    uint64_t addr;              /*!< Physical address. */
+    uint32_t len;               /*!< Length in bytes. */
+    uint16_t flags;             /*!< DESC_* flags. */
+    uint16_t next;              /*!< Next descriptor, if DESC_NEXT. */
+};
+
+/*! Ring of descriptor chains made available to the device. */
+struct vring_avail {
+    uint16_t flags;             /*!< Unused. */
+    uint16_t idx;               /*!< Where the next entry goes, mod size. */
+    uint16_t ring[];            /*!< Heads of descriptor chains. */
+};
+
+/*! Entry in the used ring. */
+struct vring_used_elem {
+    uint32_t id;                /*!< Head of the finished chain. */
+    uint32_t len;               /*!< Bytes written by the device. */
+};
+
+/*! Ring of descriptor chains handed back by the device. */
+struct vring_used {
+    uint16_t flags;             /*!< Unused. */
+    uint16_t idx;               /*!< Where the next entry goes, mod size. */
+    struct vring_used_elem ring[];      /*!< Finished chains. */
+};
+
+/*! Header of a block request, read by the device. */
+struct request_header {
+    uint32_t type;              /*!< REQ_IN or REQ_OUT. */
+    uint32_t reserved;          /*!< Must be zero. */
+    uint64_t sector;            /*!< First sector. */
+};
+
+/*! A request slot.  Slot I owns descriptors I * DESCS_PER_REQUEST onward. */
+struct request {
+    struct request_header header;       /*!< Read by the device. */
+    uint8_t status;                     /*!< Written by the device. */
+    bool busy;                          /*!< In use? */
+    block_sector_t sector;              /*!< For error messages. */
+    block_done_func *done;              /*!< Called on completion. */
+    void *done_aux;                     /*!< Passed to DONE. */
+};
+
+/*! A virtio block device. */
+struct virtio_disk {
+    char name[8];               /*!< Name, e.g. "vda". */
+    uint16_t io_base;           /*!< Base I/O port. */
+    uint8_t irq;                /*!< Interrupt line. */
+
+    uint16_t queue_size;        /*!< Number of descriptors in the queue. */
+    struct vring_desc *desc;    /*!< Descriptor table. */
+    struct vring_avail *avail;  /*!< Available ring. */
+    struct vring_used *used;    /*!< Used ring. */
+    uint16_t last_used;         /*!< Used ring entries consumed so far. */
+
+    struct request *requests;   /*!< Request slots, in a page of their own. */
+    size_t request_cnt;         /*!< Number of request slots. */
+    struct semaphore free_requests;     /*!< Number of idle slots. */
+};
+
+static struct virtio_disk disks[MAX_DISKS];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static void probe(const struct pci_device *, void *aux);
+static bool setup_queue(struct virtio_disk *);
+static void interrupt_handler(struct intr_frame *);
+
+/*! Finds, initializes, and registers every virtio block device. */
+void virtio_blk_init(void) {
+    pci_scan(probe, NULL);
+}
+
+/*! Initializes PCI function D if it is a virtio block device, registers it
+    with the block layer, and scans it for partitions. */
+static void probe(const struct pci_device *d, void *aux UNUSED) {
+    struct virtio_disk *disk;
+    block_sector_t capacity;
+    struct block *block;
+    size_t i;
+
+    if (d->vendor_id != VIRTIO_VENDOR_ID ||
+        d->device_id != VIRTIO_BLK_DEVICE_ID)
+        return;
+    if (disk_cnt >= MAX_DISKS) {
+        printf("virtio-blk: ignoring device at %02x:%02x.%x, too many\n",
+               d->bus, d->dev, d->func);
+        return;
+    }
+
+    disk = &disks[disk_cnt];
+    snprintf(disk->name, sizeof disk->name, "vd%c", 'a' + (int) disk_cnt);
+    disk->io_base = pci_io_bar(d, 0);
+    disk->irq = d->irq;
+    if (disk->io_base == 0 || disk->irq >= 16) {
+        printf("%s: no usable I/O ports or interrupt\n", disk->name);
+        return;
+    }
+    pci_enable_bus_master(d);
+
+    /* Reset, then announce ourselves.  We need no optional features. */
+    outb(reg_status(disk), 0);
+    outb(reg_status(disk), STATUS_ACKNOWLEDGE);
+    outb(reg_status(disk), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+    outl(reg_guest_features(disk), 0);
+    if (!setup_queue(disk)) {
+        outb(reg_status(disk), STATUS_FAILED);
+        return;
+    }
+
+    /* The same interrupt line may be shared with an earlier disk. */
+    for (i = 0; i < disk_cnt; i++)
+        if (disks[i].irq == disk->irq)
+            break;
+    if (i == disk_cnt)
+        intr_register_ext(disk->irq + 0x20, interrupt_handler, "virtio-blk");
+    disk_cnt++;
+
+    outb(reg_status(disk),
+         STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+    /* Devices over 2 TB don't fit in a block_sector_t; use what we can. */
+    capacity = inl(reg_capacity(disk) + 4) != 0
+               ? (block_sector_t) -1 : inl(reg_capacity(disk));
+    block = block_register(disk->name, BLOCK_RAW, "virtio", capacity,
+                           &virtio_operations, disk);
+    partition_scan(block);
+}
+
+/*! Allocates and registers DISK's virtqueue and request slots.  Returns
+    true if successful. */
+static bool setup_queue(struct virtio_disk *disk) {
+    size_t avail_ofs, used_ofs, size;
+    uint8_t *queue;
+    size_t i;
+
+    outw(reg_queue_select(disk), 0);
+    disk->queue_size = inw(reg_queue_size(disk));
+    if (disk->queue_size < DESCS_PER_REQUEST) {
+        printf("%s: virtqueue too small\n", disk->name);
+        return false;
+    }
+
+    /* Legacy layout: descriptors, then the available ring, then the used
+       ring on the next QUEUE_ALIGN boundary. */
+    avail_ofs = sizeof *disk->desc * disk->queue_size;
+    used_ofs = ROUND_UP(avail_ofs + sizeof *disk->avail
+                        + sizeof (uint16_t) * (disk->queue_size + 1),
+                        QUEUE_ALIGN);
+    size = used_ofs + sizeof *disk->used
+           + sizeof (struct vring_used_elem) * disk->queue_size
+           + sizeof (uint16_t);
+    queue = palloc_get_multiple(PAL_ZERO, DIV_ROUND_UP(size, PGSIZE));
+    disk->requests = palloc_get_page(PAL_ZERO);
+    if (queue == NULL || disk->requests == NULL) {
+        printf("%s: out of memory for virtqueue\n", disk->name);
+        return false;
+    }
+    disk->desc = (struct vring_desc *) queue;
+    disk->avail = (struct vring_avail *) (queue + avail_ofs);
+    disk->used = (struct vring_used *) (queue + used_ofs);
+    disk->last_used = 0;
+
+    disk->request_cnt = disk->queue_size / DESCS_PER_REQUEST;
+    if (disk->request_cnt > MAX_REQUESTS)
+        disk->request_cnt = MAX_REQUESTS;
+    ASSERT(disk->request_cnt * sizeof *disk->requests <= PGSIZE);
+    for (i = 0; i < disk->request_cnt; i++)
+        disk->requests[i].busy = false;
+    sema_init(&disk->free_requests, disk->request_cnt);
+
+    outl(reg_queue_pfn(disk), vtop(queue) / QUEUE_ALIGN);
+    return true;
+}
+
+/*! Takes an idle request slot of DISK, waiting for one if need be, and
+    returns its index. */
+static size_t get_request(struct virtio_disk *disk) {
+    enum intr_level old_level;
+    size_t i;
+
+    sema_down(&disk->free_requests);
+    old_level = intr_disable();
+    for (i = 0; disk->requests[i].busy; i++)
+        ASSERT(i + 1 < disk->request_cnt);
+    disk->requests[i].busy = true;
+    intr_set_level(old_level);
+    return i;
+}
+
+/*! Fills in descriptor DESC to point at the SIZE bytes at kernel address
+    P, chained to descriptor NEXT. */
+static void set_desc(struct vring_desc *desc, const void *p, size_t size,
+                     uint16_t flags, uint16_t next) {
+    desc->addr = vtop(p);
+    desc->len = size;
+    desc->flags = flags;
+    desc->next = next;
+}
+
+/*! Starts a transfer of CNT sectors, at most BLOCK_MAX_MERGE_SECTORS,
+    starting at SEC_NO between disk D_ and BUFFER, and returns without
+    waiting.  Calls DONE(DONE_AUX) from the interrupt handler when the
+    transfer is complete.  Waits first if all request slots are busy. */
+static void virtio_start(void *d_, block_sector_t sec_no, size_t cnt,
+                         void *buffer, bool write, block_done_func *done,
+                         void *done_aux) {
+    struct virtio_disk *disk = d_;
+    size_t slot = get_request(disk);
+    struct request *req = &disk->requests[slot];
+    uint16_t head = slot * DESCS_PER_REQUEST;
+    uint16_t d = head;
+    uint8_t *p = buffer;
+    size_t size = cnt * BLOCK_SECTOR_SIZE;
+    enum intr_level old_level;
+
+    ASSERT(cnt > 0 && cnt <= BLOCK_MAX_MERGE_SECTORS);
+    ASSERT(is_kernel_vaddr(buffer));
+
+    req->header.type = write ? REQ_OUT : REQ_IN;
+    req->header.reserved = 0;
+    req->header.sector = sec_no;
+    req->status = 0xff;
+    req->sector = sec_no;
+    req->done = done;
+    req->done_aux = done_aux;
+
+    /* Header, then the buffer one page-bounded piece at a time, so that
+       each piece is physically contiguous, then the status byte. */
+    set_desc(&disk->desc[d], &req->header, sizeof req->header,
+             DESC_NEXT, d + 1);
+    d++;
+    while (size > 0) {
+        size_t chunk = PGSIZE - pg_ofs(p);
+        if (chunk > size)
+            chunk = size;
+        set_desc(&disk->desc[d], p, chunk,
+                 DESC_NEXT | (write ? 0 : DESC_WRITE), d + 1);
+        d++;
+        p += chunk;
+        size -= chunk;
+    }
+    set_desc(&disk->desc[d], &req->status, 1, DESC_WRITE, 0);
+    ASSERT(d < head + DESCS_PER_REQUEST);
+
+    /* Publish the chain, then tell the device. */
+    old_level = intr_disable();
+    disk->avail->ring[disk->avail->idx % disk->queue_size] = head;
+    barrier();
+    disk->avail->idx++;
+    barrier();
+    outw(reg_queue_notify(disk), 0);
+    intr_set_level(old_level);
+}
+
+/*! Completion function for virtio_transfer(). */
+static void wake_waiter(void *sema) {
+    sema_up(sema);
+}
+
+/*! Transfers CNT sectors starting at SEC_NO between disk D_ and BUFFER,
+    in pieces of at most BLOCK_MAX_MERGE_SECTORS sectors, and waits for
+    the transfer to finish. */
+static void virtio_transfer(void *d_, block_sector_t sec_no, size_t cnt,
+                            void *buffer, bool write) {
+    uint8_t *p = buffer;
+
+    while (cnt > 0) {
+        size_t xfer = cnt < BLOCK_MAX_MERGE_SECTORS
+                      ? cnt : BLOCK_MAX_MERGE_SECTORS;
+        struct semaphore done;
+
+        sema_init(&done, 0);
+        virtio_start(d_, sec_no, xfer, p, write, wake_waiter, &done);
+        sema_down(&done);
+
+        p += xfer * BLOCK_SECTOR_SIZE;
+        sec_no += xfer;
+        cnt -= xfer;
+    }
+}
+
+/*! Reads CNT sectors starting at SEC_NO from disk D_ into BUFFER. */
+static void virtio_read_multiple(void *d_, block_sector_t sec_no, size_t cnt,
+                                 void *buffer) {
+    virtio_transfer(d_, sec_no, cnt, buffer, false);
+}
+
+/*! Writes CNT sectors starting at SEC_NO to disk D_ from BUFFER. */
+static void virtio_write_multiple(void *d_, block_sector_t sec_no,
+                                  size_t cnt, const void *buffer) {
+    virtio_transfer(d_, sec_no, cnt, (void *) buffer, true);
+}
+
+/*! Reads sector SEC_NO from disk D_ into BUFFER. */
+static void virtio_read(void *d_, block_sector_t sec_no, void *buffer) {
+    virtio_transfer(d_, sec_no, 1, buffer, false);
+}
+
+/*! Writes sector SEC_NO to disk D_ from BUFFER. */
+static void virtio_write(void *d_, block_sector_t sec_no,
+                         const void *buffer) {
+    virtio_transfer(d_, sec_no, 1, (void *) buffer, true);
+}
+
+static struct block_operations virtio_operations = {
+    virtio_read,
+    virtio_write,
+    virtio_read_multiple,
+    virtio_write_multiple,
+    virtio_start
+};
+
+/*! Completes every request that DISK has handed back. */
+static void reap_used(struct virtio_disk *disk) {
+    while (disk->last_used != disk->used->idx) {
+        struct vring_used_elem *e =
+            &disk->used->ring[disk->last_used % disk->queue_size];
+        struct request *req = &disk->requests[e->id / DESCS_PER_REQUEST];
+
+        barrier();
+        if (req->status != REQ_OK)
+            PANIC("%s: disk %s failed, sector=%"PRDSNu, disk->name,
+                  req->header.type == REQ_OUT ? "write" : "read",
+                  req->sector);
+        disk->last_used++;
+
+        req->busy = false;
+        req->done(req->done_aux);
+        sema_up(&disk->free_requests);
+    }
+}
+
+/*! Virtio interrupt handler.  Serves every disk on the interrupting line;
+    reading a disk's ISR register acknowledges its interrupt. */
+static void interrupt_handler(struct intr_frame *f) {
+    size_t i;
+
+    for (i = 0; i < disk_cnt; i++) {
+        struct virtio_disk *disk = &disks[i];
+        if ((uint32_t) disk->irq + 0x20 == f->vec_no && (inb(reg_isr(disk)) & 1))
+            reap_used(disk);
+    }
+}
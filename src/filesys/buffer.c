@@ -1,7 +1,9 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <hash.h>
+#include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include "filesys/buffer.h"
@@ -11,6 +13,9 @@
 #define BUFFER_SIZE 64
 #define UNOCCUPIED UINT32_MAX
 
+// Most entries a flush keeps locked while their writes are queued.
+#define WRITEBACK_BATCH 16
+
 
 // OBJECT DEFINITIONS
 struct buffer_entry {
@@ -25,12 +30,26 @@ struct buffer_entry {
 	// been written back to disk yet.
 	bool dirty;
 
+	// While dirty, the entry sits in dirty_entries through dirty_elem.
+	// If it was dirtied on behalf of an owner (e.g. an inode), it also
+	// sits in that owner's list through owner_elem.
+	struct list_elem dirty_elem;
+	struct list *owner;
+	struct list_elem owner_elem;
+
 	// If this cache entry has been read from or written to since
 	// the last eviction algorithm pass
 	bool recently_accessed;
 
     // 512 bytes of block data
 	uint8_t storage[BLOCK_SECTOR_SIZE];
+
+	// While a read-ahead of this entry is in flight, loading is true and
+	// the entry must not be used or evicted. The device's I/O thread
+	// clears it and ups loaded once storage is filled in.
+	bool loading;
+	struct semaphore loaded;
+	struct block_request load_request;
     
     // The lock that allows multiple threads to read from but
     // only one thread to write to the storage at once.
@@ -46,6 +65,11 @@ static uint8_t buffer_unoccupied_slots;
 static struct hash buffer_table;
 static struct lock buffer_table_lock;
 
+// Every dirty entry, so that flushing doesn't scan clean ones.
+// The owner lists of the entries are protected by the same lock.
+static struct list dirty_entries;
+static struct lock dirty_lock;
+
 // This is a number, ranging between 0 and BUFFER_SIZE,
 // that represents where the eviction clock algorithm is
 // pointing in the array of buffer elements right now.
@@ -83,39 +107,189 @@ void buffer_init(void) {
 
 	lock_init(&buffer_table_lock);
 
+	list_init(&dirty_entries);
+	lock_init(&dirty_lock);
+
 	eviction_clock_position = 0;
 
 	int i;
 	for (i = 0; i < BUFFER_SIZE; i++) {
 		buffer[i].occupied_by_sector = UNOCCUPIED;
 		buffer[i].dirty = false;
+		buffer[i].owner = NULL;
 		buffer[i].recently_accessed = false;
+		buffer[i].loading = false;
+		sema_init(&buffer[i].loaded, 0);
 		lock_init(&buffer[i].lock);
 	}
 }
 
+// Marks the entry dirty, filing it under OWNER if it isn't filed yet.
+// OWNER may be null for writes that don't belong to anyone in particular.
+// Precondition: The buffer entry's lock is held by the current thread.
+static void mark_dirty(struct buffer_entry *b, struct list *owner) {
+	ASSERT(lock_held_by_current_thread(&(b->lock)));
+	lock_acquire(&dirty_lock);
+	if (!b->dirty) {
+		b->dirty = true;
+		list_push_back(&dirty_entries, &b->dirty_elem);
+	}
+	if (owner != NULL && b->owner == NULL) {
+		b->owner = owner;
+		list_push_back(owner, &b->owner_elem);
+	}
+	lock_release(&dirty_lock);
+}
+
+// Takes the entry off the dirty lists once its data has reached disk.
+// Precondition: The buffer entry's lock is held by the current thread.
+static void mark_clean(struct buffer_entry *b) {
+	ASSERT(lock_held_by_current_thread(&(b->lock)));
+	lock_acquire(&dirty_lock);
+	b->dirty = false;
+	list_remove(&b->dirty_elem);
+	if (b->owner != NULL) {
+		list_remove(&b->owner_elem);
+		b->owner = NULL;
+	}
+	lock_release(&dirty_lock);
+}
+
 // Precondition: The buffer entry's lock is held by the current thread.
 void writeback_dirty_buffer_entry(struct buffer_entry* b) {
 	ASSERT(lock_held_by_current_thread(&(b->lock)));
 	ASSERT(b->dirty == true);
 	block_write(fs_device, b->occupied_by_sector, &(b->storage));
-	b->dirty = false;
+	mark_clean(b);
+}
+
+// Completion function for requests someone waits on through a
+// semaphore passed as their aux.
+static void wake_waiter(struct block_request *r) {
+	sema_up(r->aux);
+}
+
+// Queues a write of each of the CNT entries in BATCH, leaving it to the
+// device's elevator to order and merge them, and waits for all of them.
+// Then marks the entries clean and releases them.
+// Precondition: Every entry's lock is held by the current thread.
+static void writeback_batch(struct buffer_entry **batch, int cnt) {
+	struct block_request requests[WRITEBACK_BATCH];
+	struct semaphore done;
+	int i;
+
+	sema_init(&done, 0);
+	for (i = 0; i < cnt; i++) {
+		struct block_request *r = &requests[i];
+		r->sector = batch[i]->occupied_by_sector;
+		r->cnt = 1;
+		r->buffer = batch[i]->storage;
+		r->write = true;
+		r->complete = wake_waiter;
+		r->aux = &done;
+		block_submit(fs_device, r);
+	}
+	for (i = 0; i < cnt; i++)
+		sema_down(&done);
+
+	for (i = 0; i < cnt; i++) {
+		mark_clean(batch[i]);
+		lock_release(&batch[i]->lock);
+	}
+}
+
+// A dirty entry noted down for writeback, along with the sector it
+// held at the time, since it may have been evicted by the time we get
+// around to it.
+struct writeback {
+	struct buffer_entry *entry;
+	block_sector_t sector;
+};
+
+// Writes back the CNT PENDING entries in ascending sector order, skipping
+// any that were written back or reused in the meantime. They are queued
+// in batches so that runs of consecutive sectors go out together. An
+// entry may have been reused for a lower sector since it was noted down,
+// so while a batch holds entry locks we only ever try to lock the next
+// entry; if somebody else has it, the batch goes out first and we wait
+// for the entry holding no other entry lock.
+static void writeback_in_sector_order(struct writeback *pending, int cnt) {
+	int i, j;
+
+	// Insertion sort; there are never more than BUFFER_SIZE of these.
+	for (i = 1; i < cnt; i++) {
+		struct writeback w = pending[i];
+		for (j = i; j > 0 && pending[j - 1].sector > w.sector; j--)
+			pending[j] = pending[j - 1];
+		pending[j] = w;
+	}
+
+	struct buffer_entry *batch[WRITEBACK_BATCH];
+	int batch_cnt = 0;
+	for (i = 0; i < cnt; i++) {
+		struct buffer_entry *b = pending[i].entry;
+		if (batch_cnt == 0 || !lock_try_acquire(&b->lock)) {
+			writeback_batch(batch, batch_cnt);
+			batch_cnt = 0;
+			lock_acquire(&b->lock);
+		}
+		if (!b->dirty || b->occupied_by_sector != pending[i].sector) {
+			lock_release(&b->lock);
+			continue;
+		}
+		batch[batch_cnt++] = b;
+		if (batch_cnt == WRITEBACK_BATCH) {
+			writeback_batch(batch, batch_cnt);
+			batch_cnt = 0;
+		}
+	}
+	writeback_batch(batch, batch_cnt);
+}
+
+// Notes down every entry in LIST, a list of entries threaded through
+// the member at ELEM_OFS, and writes them back in sector order.
+static void writeback_list(struct list *list, size_t elem_ofs) {
+	struct writeback entries[BUFFER_SIZE];
+	struct list_elem *e;
+	int cnt = 0;
+
+	lock_acquire(&dirty_lock);
+	for (e = list_begin(list); e != list_end(list); e = list_next(e)) {
+		struct buffer_entry *b = (struct buffer_entry *)((uint8_t *)e - elem_ofs);
+		entries[cnt].entry = b;
+		entries[cnt].sector = b->occupied_by_sector;
+		cnt++;
+	}
+	lock_release(&dirty_lock);
+
+	writeback_in_sector_order(entries, cnt);
 }
 
-// This function just writes back all dirty entries in the cache.
+// This function just writes back all dirty entries in the cache,
+// in sector order.
 void buffer_flush(void) {
 	// This function makes no effort to prevent writes while it's
 	// running, except for the block currently being written back.
 	// We thought about it and couldn't think of any reason it'd be helpful.
+	writeback_list(&dirty_entries, offsetof(struct buffer_entry, dirty_elem));
+}
 
-	int i = 0;
-	for (i = 0; i < BUFFER_SIZE; i++) {
-		lock_acquire(&(buffer[i].lock));
-		if (buffer[i].dirty) {
-			writeback_dirty_buffer_entry(&buffer[i]);
-		}
-		lock_release(&(buffer[i].lock));
+// Writes back, in sector order, every entry dirtied on behalf of OWNER
+// and not yet written back. Clean entries are never visited.
+void buffer_flush_owned(struct list *owner) {
+	writeback_list(owner, offsetof(struct buffer_entry, owner_elem));
+}
+
+// Forgets OWNER, e.g. because the inode it belongs to is going away. Its
+// entries stay dirty and will still be written back by eviction or a
+// full flush.
+void buffer_disown(struct list *owner) {
+	lock_acquire(&dirty_lock);
+	while (!list_empty(owner)) {
+		struct list_elem *e = list_pop_front(owner);
+		list_entry(e, struct buffer_entry, owner_elem)->owner = NULL;
 	}
+	lock_release(&dirty_lock);
 }
 
 // This accepts a sector number and looks up the buffer_entry struct for that
@@ -173,6 +347,9 @@ struct buffer_entry *buffer_acquire_existing_entry(block_sector_t sector) {
         lock_acquire(&b->lock);
     }
     
+    // If it's still being read ahead, wait for the data to arrive.
+    if (b->loading) sema_down(&b->loaded);
+
     // Guess we acquired it.
     return b;
 }
@@ -201,9 +378,12 @@ struct buffer_entry* buffer_acquire_free_slot(void) {
     else {
         b = &buffer[eviction_clock_position];
 
-        // If a buffer slot is either recently accessed or locked,
-        // we just keep looking.
-        while (b->recently_accessed || !lock_try_acquire(&b->lock)) {
+        // If a buffer slot is either recently accessed, locked, or
+        // still being read ahead, we just keep looking. This includes
+        // slots that we hold ourselves while copying between two sectors.
+        while (b->recently_accessed || b->loading ||
+               lock_held_by_current_thread(&b->lock) ||
+               !lock_try_acquire(&b->lock)) {
         	b->recently_accessed = false;
         	eviction_clock_position += 1;
         	eviction_clock_position %= 64;
@@ -223,7 +403,9 @@ struct buffer_entry* buffer_acquire_free_slot(void) {
 
 // Precondition: The global lock isn't held.
 // Postcondition: The global lock isn't held, but the entry lock is.
-struct buffer_entry *buffer_acquire(block_sector_t sector) {
+// If LOAD is false and the sector isn't cached, the entry's storage is
+// left uninitialized; the caller must overwrite all of it.
+static struct buffer_entry *_buffer_acquire(block_sector_t sector, bool load) {
     // Acquire the global lock. Will be automatically released
     // when an existing entry or free slot is acquired.
     lock_acquire(&buffer_table_lock);
@@ -240,19 +422,64 @@ struct buffer_entry *buffer_acquire(block_sector_t sector) {
         hash_insert(&buffer_table, &(b->hash_elem));
         lock_release(&buffer_table_lock);
 
-        // Read the on-disk data into the buffer.
-        block_read(fs_device, sector, &(b->storage));
+        // Read the on-disk data into the buffer, unless the caller
+        // is about to overwrite the whole sector anyway.
+        if (load) block_read(fs_device, sector, &(b->storage));
     }
     
     return b;
 }
 
+// Precondition: The global lock isn't held.
+// Postcondition: The global lock isn't held, but the entry lock is.
+struct buffer_entry *buffer_acquire(block_sector_t sector) {
+    return _buffer_acquire(sector, true);
+}
+
 // Precondition: The entry lock is held.
 // Postcondition: The global lock isn't held, but the entry lock is.
 void buffer_release(struct buffer_entry *b) {
     lock_release(&(b->lock));
 }
 
+// Completion function for read-ahead: the entry's data is in.
+static void finish_read_ahead(struct block_request *r) {
+    struct buffer_entry *b = r->aux;
+    b->loading = false;
+    sema_up(&b->loaded);
+}
+
+// Starts reading SECTOR into the cache in the background, unless it is
+// cached already, and returns without waiting. Whoever acquires the entry
+// before the data arrives waits for it then.
+void buffer_read_ahead(block_sector_t sector) {
+    lock_acquire(&buffer_table_lock);
+    if (_buffer_entry_for_sector(sector) != NULL) {
+        lock_release(&buffer_table_lock);
+        return;
+    }
+
+    // Grab a buffer entry, lock acquired, and set it up.
+    struct buffer_entry *b = buffer_acquire_free_slot();
+    b->occupied_by_sector = sector;
+    b->recently_accessed = true;
+    hash_insert(&buffer_table, &(b->hash_elem));
+    lock_release(&buffer_table_lock);
+
+    // Nobody else can be waiting on loaded, since we hold the entry.
+    b->loading = true;
+    sema_init(&b->loaded, 0);
+    struct block_request *r = &b->load_request;
+    r->sector = sector;
+    r->cnt = 1;
+    r->buffer = b->storage;
+    r->write = false;
+    r->complete = finish_read_ahead;
+    r->aux = b;
+    block_submit(fs_device, r);
+    buffer_release(b);
+}
+
 // This function is almost always used with its convenience method,
 // buffer_read, which gets BLOCK_SECTOR_SIZE bytes.
 // This function reads up to 512 bytes from the cache.
@@ -279,21 +506,76 @@ void buffer_read(block_sector_t sector, void* buffer) {
 // buffer_read, which gets BLOCK_SECTOR_SIZE bytes.
 // This function writes up to 512 bytes to the cache.
 void buffer_write_bytes(block_sector_t sector, off_t sector_ofs, size_t num_bytes, const void* buffer) {
+	buffer_write_bytes_owned(sector, sector_ofs, num_bytes, buffer, NULL);
+}
+void buffer_write(block_sector_t sector, const void* buffer) {
+	buffer_write_bytes(sector, 0, BLOCK_SECTOR_SIZE, buffer);
+}
+
+// As buffer_write_bytes, but files the dirtied entry under OWNER so that
+// buffer_flush_owned can find it.
+void buffer_write_bytes_owned(block_sector_t sector, off_t sector_ofs, size_t num_bytes,
+                              const void* buffer, struct list *owner) {
 	ASSERT(sector_ofs >= 0 && sector_ofs < BLOCK_SECTOR_SIZE);
 	ASSERT(num_bytes > 0 && num_bytes <= BLOCK_SECTOR_SIZE);
 
     // Obtain buffer entry with that sector. This function
     // abstracts away a lot of important things, read it.
-    struct buffer_entry *b = buffer_acquire(sector);
+    // A write of the whole sector doesn't need the old contents.
+    bool whole_sector = sector_ofs == 0 && num_bytes == BLOCK_SECTOR_SIZE;
+    struct buffer_entry *b = _buffer_acquire(sector, !whole_sector);
 
     // Copy the buffer data into our cache.
     void* start = (void *)(((uint8_t *)(&(b->storage))) + sector_ofs);
     memcpy(start, buffer, num_bytes);
-    b->dirty = true;
+    mark_dirty(b, owner);
     
     // Release the lock on the buffer.
     buffer_release(b);
 }
-void buffer_write(block_sector_t sector, const void* buffer) {
-	buffer_write_bytes(sector, 0, BLOCK_SECTOR_SIZE, buffer);
+
+// Copies NUM_BYTES from one cached sector to another without an
+// intermediate buffer. Either sector may be read in if it isn't cached.
+// The destination is filed under OWNER, which may be null.
+void buffer_copy_bytes(block_sector_t dst_sector, off_t dst_ofs,
+                       block_sector_t src_sector, off_t src_ofs, size_t num_bytes,
+                       struct list *owner) {
+    ASSERT(dst_ofs >= 0 && dst_ofs + num_bytes <= BLOCK_SECTOR_SIZE);
+    ASSERT(src_ofs >= 0 && src_ofs + num_bytes <= BLOCK_SECTOR_SIZE);
+    ASSERT(num_bytes > 0);
+
+    bool whole_sector = dst_ofs == 0 && num_bytes == BLOCK_SECTOR_SIZE;
+    struct buffer_entry *src, *dst;
+    if (src_sector == dst_sector) {
+        src = dst = buffer_acquire(src_sector);
+    }
+    // Always lock the lower sector first so that two copies running in
+    // opposite directions can't deadlock.
+    else if (src_sector < dst_sector) {
+        src = buffer_acquire(src_sector);
+        dst = _buffer_acquire(dst_sector, !whole_sector);
+    } else {
+        dst = _buffer_acquire(dst_sector, !whole_sector);
+        src = buffer_acquire(src_sector);
+    }
+
+    memmove(dst->storage + dst_ofs, src->storage + src_ofs, num_bytes);
+    mark_dirty(dst, owner);
+
+    if (src != dst) buffer_release(src);
+    buffer_release(dst);
+}
+
+// Writes back the given sector if it is cached and dirty.
+void buffer_flush_sector(block_sector_t sector) {
+	lock_acquire(&buffer_table_lock);
+	struct buffer_entry *b = buffer_acquire_existing_entry(sector);
+	if (b == NULL) {
+		lock_release(&buffer_table_lock);
+		return;
+	}
+	if (b->dirty) {
+		writeback_dirty_buffer_entry(b);
+	}
+	lock_release(&b->lock);
 }
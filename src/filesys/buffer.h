@@ -1,6 +1,7 @@
 #ifndef FILESYS_BUFFER_H
 #define FILESYS_BUFFER_H
 
+#include <list.h>
 #include "devices/block.h"
 #include "filesys/off_t.h"
 
@@ -10,9 +11,21 @@
 void buffer_init(void);
 void buffer_flush(void);
 void buffer_read(block_sector_t sector, void* buffer);
+void buffer_read_ahead(block_sector_t sector);
 void buffer_write(block_sector_t sector, const void* buffer);
 void buffer_read_bytes(block_sector_t sector, off_t sector_ofs, size_t num_bytes, void* buffer);
 void buffer_write_bytes(block_sector_t sector, off_t sector_ofs, size_t num_bytes, const void* buffer);
+void buffer_copy_bytes(block_sector_t dst_sector, off_t dst_ofs,
+                       block_sector_t src_sector, off_t src_ofs, size_t num_bytes,
+                       struct list *owner);
+
+// Dirty tracking per owner. An owner is a list, normally embedded in an
+// inode, that collects the cache entries written on its behalf.
+void buffer_write_bytes_owned(block_sector_t sector, off_t sector_ofs, size_t num_bytes,
+                              const void* buffer, struct list *owner);
+void buffer_flush_owned(struct list *owner);
+void buffer_disown(struct list *owner);
+void buffer_flush_sector(block_sector_t sector);
 
 // Evaluates to the data from the given sector as interpreted
 // as the specified struct type.
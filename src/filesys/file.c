@@ -97,6 +97,30 @@ off_t file_write_at(struct file *file, const void *buffer, off_t size,
     return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
+/*! Copies SIZE bytes from SRC into DST, starting at each file's current
+    position, without passing the data through a caller's buffer.  Returns
+    the number of bytes actually copied, which may be less than SIZE if end
+    of SRC is reached.  Advances both files' positions by that amount.
+    Returns -1 if SRC and DST share an inode and the two ranges overlap. */
+off_t file_copy(struct file *dst, struct file *src, off_t size) {
+    ASSERT(dst != NULL);
+    ASSERT(src != NULL);
+    if (dst->inode == src->inode &&
+        dst->pos < src->pos + size && src->pos < dst->pos + size)
+        return -1;
+    off_t bytes_copied = inode_copy_at(dst->inode, dst->pos,
+                                       src->inode, src->pos, size);
+    src->pos += bytes_copied;
+    dst->pos += bytes_copied;
+    return bytes_copied;
+}
+
+/*! Writes FILE's dirty data and metadata back to disk. */
+void file_sync(struct file *file) {
+    ASSERT(file != NULL);
+    inode_sync(file->inode);
+}
+
 /*! Prevents write operations on FILE's underlying inode
     until file_allow_write() is called or FILE is closed. */
 void file_deny_write(struct file *file) {
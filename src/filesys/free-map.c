@@ -1,6 +1,7 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -12,6 +13,17 @@ static struct bitmap *free_map;      /*!< Free map, one bit per sector. */
 static bool writing_free_map = false;
 static struct lock lock;
 
+/*! Running totals, kept up to date by every allocation and release so
+    that nobody has to count bits.  Protected by LOCK. @{ */
+static size_t free_cnt;              /*!< Number of free sectors. */
+static size_t group_size;            /*!< Sectors per group. */
+static size_t group_free_cnt[STATFS_GROUP_CNT]; /*!< Free sectors per group. */
+static block_sector_t run_start;     /*!< Start of the largest known free run. */
+static size_t run_cnt;               /*!< Length of the largest known free run. */
+/*! @} */
+
+static void recount(void);
+
 /*! Initializes the free map. */
 void free_map_init(void) {
     free_map = bitmap_create(block_size(fs_device));
@@ -20,32 +32,138 @@ void free_map_init(void) {
     bitmap_mark(free_map, FREE_MAP_SECTOR);
     bitmap_mark(free_map, ROOT_DIR_SECTOR);
     lock_init(&lock);
+    group_size = DIV_ROUND_UP(bitmap_size(free_map), STATFS_GROUP_CNT);
+    recount();
+}
+
+/*! Recomputes every running total with one pass over the free map.  Only
+    needed when the whole map is replaced, i.e. at startup. */
+static void recount(void) {
+    size_t size = bitmap_size(free_map);
+    size_t cur_start = 0, cur_cnt = 0;
+    size_t i;
+
+    free_cnt = 0;
+    run_start = run_cnt = 0;
+    for (i = 0; i < STATFS_GROUP_CNT; i++)
+        group_free_cnt[i] = 0;
+
+    for (i = 0; i < size; i++) {
+        if (bitmap_test(free_map, i)) {
+            cur_cnt = 0;
+            continue;
+        }
+        free_cnt++;
+        group_free_cnt[i / group_size]++;
+        if (cur_cnt++ == 0)
+            cur_start = i;
+        if (cur_cnt > run_cnt) {
+            run_start = cur_start;
+            run_cnt = cur_cnt;
+        }
+    }
+}
+
+/*! Adds (SIGN is +1) or subtracts (SIGN is -1) the CNT sectors starting
+    at SECTOR to or from the free count of every group they overlap. */
+static void adjust_groups(block_sector_t sector, size_t cnt, int sign) {
+    while (cnt > 0) {
+        size_t group = sector / group_size;
+        size_t group_end = (group + 1) * group_size;
+        size_t chunk = group_end - sector < cnt ? group_end - sector : cnt;
+        group_free_cnt[group] += sign * (int) chunk;
+        sector += chunk;
+        cnt -= chunk;
+    }
+}
+
+/*! Updates the running totals after CNT sectors starting at SECTOR were
+    taken.  If they were carved out of the largest known run, the larger
+    of the two leftover pieces becomes the new largest known run.
+    Precondition: LOCK is held. */
+static void note_allocated(block_sector_t sector, size_t cnt) {
+    free_cnt -= cnt;
+    adjust_groups(sector, cnt, -1);
+
+    block_sector_t end = sector + cnt;
+    block_sector_t known_end = run_start + run_cnt;
+    if (sector < known_end && run_start < end) {
+        size_t before = sector > run_start ? sector - run_start : 0;
+        size_t after = known_end > end ? known_end - end : 0;
+        if (before >= after) {
+            run_cnt = before;
+        } else {
+            run_start = end;
+            run_cnt = after;
+        }
+    }
+}
+
+/*! Updates the running totals after CNT sectors starting at SECTOR were
+    given back.  A released range that touches the largest known run is
+    merged into it; otherwise it replaces it if it is longer.
+    Precondition: LOCK is held. */
+static void note_released(block_sector_t sector, size_t cnt) {
+    free_cnt += cnt;
+    adjust_groups(sector, cnt, +1);
+
+    if (sector + cnt == run_start) {
+        run_start = sector;
+        run_cnt += cnt;
+    } else if (run_start + run_cnt == sector) {
+        run_cnt += cnt;
+    } else if (cnt > run_cnt) {
+        run_start = sector;
+        run_cnt = cnt;
+    }
 }
 
 /*! Allocates a sectors from the free map and returns it. If the free_map file
     could not be written, returns -1. */
 block_sector_t free_map_allocate(void) {
+    block_sector_t sector;
+    return free_map_allocate_multiple(1, &sector) ? sector : (block_sector_t) -1;
+}
+
+/*! Allocates CNT consecutive sectors from the free map and stores the first
+    into *SECTORP.  The free map file is rewritten once for the whole run.
+    Returns true if successful, false if not enough consecutive sectors were
+    available or if the free_map file could not be written. */
+bool free_map_allocate_multiple(size_t cnt, block_sector_t *sectorp) {
     lock_acquire(&lock);
-    block_sector_t sector = bitmap_scan_and_flip(free_map, 0, 1, false);
+    block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
+    if (sector != BITMAP_ERROR)
+        note_allocated(sector, cnt);
     if (!writing_free_map) {
         writing_free_map = true;
         lock_release(&lock);
         if (sector != BITMAP_ERROR && free_map_file != NULL &&
             !bitmap_write(free_map, free_map_file)) {
-            bitmap_set_multiple(free_map, sector, 1, false);
+            lock_acquire(&lock);
+            bitmap_set_multiple(free_map, sector, cnt, false);
+            note_released(sector, cnt);
+            lock_release(&lock);
             sector = BITMAP_ERROR;
         }
         writing_free_map = false;
     }
     else lock_release(&lock);
-    return (sector == BITMAP_ERROR) ? -1 : sector;
+    if (sector != BITMAP_ERROR)
+        *sectorp = sector;
+    return sector != BITMAP_ERROR;
 }
 
 /*! Makes the sectors available for use. */
 void free_map_release(block_sector_t sector) {
+    free_map_release_multiple(sector, 1);
+}
+
+/*! Makes CNT consecutive sectors starting at SECTOR available for use. */
+void free_map_release_multiple(block_sector_t sector, size_t cnt) {
     lock_acquire(&lock);
-    ASSERT(bitmap_all(free_map, sector, 1));
-    bitmap_set_multiple(free_map, sector, 1, false);
+    ASSERT(bitmap_all(free_map, sector, cnt));
+    bitmap_set_multiple(free_map, sector, cnt, false);
+    note_released(sector, cnt);
     lock_release(&lock);
     bitmap_write(free_map, free_map_file);
 }
@@ -57,6 +175,9 @@ void free_map_open(void) {
         PANIC("can't open free map");
     if (!bitmap_read(free_map, free_map_file))
         PANIC("can't read free map");
+    lock_acquire(&lock);
+    recount();
+    lock_release(&lock);
 }
 
 /*! Writes the free map to disk and closes the free map file. */
@@ -64,6 +185,28 @@ void free_map_close(void) {
     file_close(free_map_file);
 }
 
+/*! Fills in *STATS from the running totals, without touching the
+    bitmap. */
+void free_map_stat(struct statfs *stats) {
+    size_t i;
+
+    lock_acquire(&lock);
+    stats->sector_size = BLOCK_SECTOR_SIZE;
+    stats->sector_cnt = bitmap_size(free_map);
+    stats->free_cnt = free_cnt;
+    stats->largest_run_cnt = run_cnt;
+    stats->group_size = group_size;
+    for (i = 0; i < STATFS_GROUP_CNT; i++)
+        stats->group_free_cnt[i] = group_free_cnt[i];
+    lock_release(&lock);
+}
+
+/*! Writes the free map file's dirty sectors back to disk. */
+void free_map_sync(void) {
+    if (free_map_file != NULL)
+        file_sync(free_map_file);
+}
+
 /*! Creates a new free map file on disk and writes the free map to it. */
 void free_map_create(void) {
     /* Create inode. */
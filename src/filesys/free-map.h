@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <statfs.h>
 #include "devices/block.h"
 
 void free_map_init(void);
@@ -10,9 +11,13 @@ void free_map_read(void);
 void free_map_create(void);
 void free_map_open(void);
 void free_map_close(void);
+void free_map_sync(void);
+void free_map_stat(struct statfs *);
 
 block_sector_t free_map_allocate(void);
+bool free_map_allocate_multiple(size_t cnt, block_sector_t *sectorp);
 void free_map_release(block_sector_t);
+void free_map_release_multiple(block_sector_t, size_t cnt);
 
 #endif /* filesys/free-map.h */
 
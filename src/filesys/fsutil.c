@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -67,9 +69,9 @@ void fsutil_extract(char **argv UNUSED) {
     struct block *src;
     void *header, *data;
 
-    /* Allocate buffers. */
+    /* Allocate buffers.  File data is copied a page at a time. */
     header = malloc(BLOCK_SECTOR_SIZE);
-    data = malloc(BLOCK_SECTOR_SIZE);
+    data = palloc_get_page(0);
     if (header == NULL || data == NULL)
         PANIC("couldn't allocate buffers");
 
@@ -107,18 +109,22 @@ void fsutil_extract(char **argv UNUSED) {
 
             printf("Putting '%s' into the file system...\n", file_name);
 
-            /* Create destination file. */
+            /* Create destination file at its final size and reserve
+               a run of sectors for it, which the copy below fills in
+               order. */
             if (!filesys_create(file_name, size))
                 PANIC("%s: create failed", file_name);
             dst = filesys_open(file_name);
             if (dst == NULL)
                 PANIC("%s: open failed", file_name);
+            inode_reserve(file_get_inode(dst));
 
             /* Do copy. */
             while (size > 0) {
-                int chunk_size =
-                    (size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size);
-                block_read(src, sector++, data);
+                int chunk_size = (size > PGSIZE ? PGSIZE : size);
+                int sector_cnt = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+                block_read_multiple(src, sector, sector_cnt, data);
+                sector += sector_cnt;
                 if (file_write(dst, data, chunk_size) != chunk_size) {
                     PANIC("%s: write failed with %d bytes unwritten",
                           file_name, size);
@@ -140,7 +146,7 @@ void fsutil_extract(char **argv UNUSED) {
     block_write(src, 0, header);
     block_write(src, 1, header);
 
-    free(data);
+    palloc_free_page(data);
     free(header);
 }
 
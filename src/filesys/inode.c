@@ -7,6 +7,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#ifdef VM
+#include "vm/text.h"
+#endif
 
 // Hardcoded pow for compile-time optimization
 #define pow(a, b) ((b == 0) ? 1 : (b == 1) ? a : \
@@ -100,19 +103,47 @@ static size_t num_inode_root_sectors_below_level(enum indirection_level target_l
     return count;
 }
 
+// Allocates a new sector for the inode, taking it from the inode's reserved
+// run if it has one. The sector is filled from INIT, a whole sector of data,
+// or zeroed if INIT is null, so that a fresh indirection sector has no
+// loaded entries and fresh data reads back as zeros. Either way only the
+// cache is written; the old contents are never read in.
+// Precondition: The inode's extend lock is held.
+static block_sector_t allocate_sector(struct inode *inode, const void *init) {
+    static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+    block_sector_t sector;
+
+    ASSERT(lock_held_by_current_thread(&inode->extend_lock));
+    if (inode->reserved_cnt > 0) {
+        sector = inode->reserved_start++;
+        inode->reserved_cnt--;
+    } else {
+        sector = free_map_allocate();
+        if (sector <= 0) PANIC("Unable to allocate.\n");
+    }
+    buffer_write_bytes_owned(sector, 0, BLOCK_SECTOR_SIZE, init != NULL ? init : zeros,
+                             &inode->dirty_sectors);
+    return sector;
+}
+
 // Returns the sector at a given index, allocating it if it doesn't yet exist.
-static block_sector_t get_indirect_sector(struct inode *inode, block_sector_t source_sector, size_t index) {
+// A new sector is filled from INIT (see allocate_sector), in which case
+// *INITIALIZED is set. The sector is filled before its entry is, so nobody
+// can look it up while it still holds stale data.
+static block_sector_t get_indirect_sector(struct inode *inode, block_sector_t source_sector, size_t index,
+                                          const void *init, bool *initialized) {
     bool already_acquired = lock_held_by_current_thread(&inode->extend_lock);
     if (!already_acquired) lock_acquire(&inode->extend_lock);
     struct indirect_sector_entry entry = buffer_read_member(source_sector, struct indirect_sector, sectors[index]);
     
     // The sector is being accessed, so let's load it if it isn't yet loaded.
     if (!entry.loaded) {
-        entry.sector = free_map_allocate();
-        if (entry.sector <= 0) PANIC("Unable to allocate.\n");
+        entry.sector = allocate_sector(inode, init);
         entry.loaded = true;
-        buffer_write_member(source_sector, struct indirect_sector, sectors[index],
-                            entry);
+        if (init != NULL) *initialized = true;
+        buffer_write_bytes_owned(source_sector,
+                                 offsetof(struct indirect_sector, sectors[index]),
+                                 sizeof entry, &entry, &inode->dirty_sectors);
     }
     if (!already_acquired) lock_release(&inode->extend_lock);
 
@@ -120,8 +151,10 @@ static block_sector_t get_indirect_sector(struct inode *inode, block_sector_t so
 }
 
 // Given an index, the array of sector data, and the indirection level of this data,
-// computes the corresponding sector.
-static block_sector_t _sector_at_indirect_index(struct inode *inode, size_t index, block_sector_t source_sector, enum indirection_level level) {
+// computes the corresponding sector. A newly allocated data sector is filled from
+// INIT; indirection sectors are always zeroed.
+static block_sector_t _sector_at_indirect_index(struct inode *inode, size_t index, block_sector_t source_sector, enum indirection_level level,
+                                                const void *init, bool *initialized) {
     // The index of our sector in the level is simply the given index.
     size_t index_in_level = index;
     size_t sectors_per_level = num_sectors_per_level(level);
@@ -137,16 +170,20 @@ static block_sector_t _sector_at_indirect_index(struct inode *inode, size_t inde
     // Sector index is the same as the index of the sector in the level since there
     // are no other levels in our indirect sector data.
     size_t index_of_sector = index_of_sector_in_level;
-    block_sector_t sector = get_indirect_sector(inode, source_sector, index_of_sector);
+    block_sector_t sector = get_indirect_sector(inode, source_sector, index_of_sector,
+                                                level == DIRECT_LEVEL ? init : NULL, initialized);
 
     // If we're on the direct level, return the sector. Otherwise, recurse on looking
     // up the sector in the next lowest indirection level.
     if (level == DIRECT_LEVEL) return sector;
-    else return _sector_at_indirect_index(inode, index_in_sector, sector, level - 1);
+    else return _sector_at_indirect_index(inode, index_in_sector, sector, level - 1, init, initialized);
 }
 
 // Given an index and an inode data structure, computes the corresponding sector.
-static block_sector_t sector_at_inode_index(size_t index, const struct inode *inode) {
+// A newly allocated data sector is filled from INIT; indirection sectors are
+// always zeroed.
+static block_sector_t sector_at_inode_index(size_t index, const struct inode *inode,
+                                            const void *init, bool *initialized) {
     ASSERT(byte_for_index(index) < buffer_read_member(inode->sector, struct inode_data, length));
     
     // Determine the level from the inode index
@@ -169,13 +206,37 @@ static block_sector_t sector_at_inode_index(size_t index, const struct inode *in
     // Sector index is the index of the sector in the level plus the number of sectors
     // in the levels below.
     size_t index_of_sector = index_of_sector_in_level + num_inode_root_sectors_below_level(level);
-    block_sector_t sector = get_indirect_sector(inode, inode->sector, index_of_sector);
+    block_sector_t sector = get_indirect_sector(inode, inode->sector, index_of_sector,
+                                                level == DIRECT_LEVEL ? init : NULL, initialized);
 				
     // If we're on the direct level, return the sector. Otherwise, recurse on looking
     // up the sector in the next lowest indirection level. Note that we will not again
     // check the root inode data sector, but an indirection sector.
     if (level == DIRECT_LEVEL) return sector;
-    else return _sector_at_indirect_index(inode, index_in_sector, sector, level - 1);
+    else return _sector_at_indirect_index(inode, index_in_sector, sector, level - 1, init, initialized);
+}
+
+// The number of indirection sectors needed to reach the first DATA_CNT
+// data sectors of an inode.
+static size_t num_indirection_sectors(size_t data_cnt) {
+    size_t count = 0;
+    enum indirection_level level;
+    for (level = INDIRECT_LEVEL; level < INDIRECTION_LEVEL_COUNT; level++) {
+        size_t start = inode_sector_start_index(level);
+        if (data_cnt <= start) break;
+        
+        // Every depth of this level needs one sector per group of
+        // data sectors that it spans.
+        size_t end = inode_sector_end_index(level);
+        size_t level_cnt = (data_cnt < end ? data_cnt : end) - start;
+        size_t span = 1;
+        size_t depth;
+        for (depth = DIRECT_LEVEL; depth < level; depth++) {
+            span *= SECTORS_PER_INDIRECTION;
+            count += DIV_ROUND_UP(level_cnt, span);
+        }
+    }
+    return count;
 }
 
 /*! Returns the block device sector that contains byte offset POS
@@ -185,7 +246,19 @@ static block_sector_t sector_at_inode_index(size_t index, const struct inode *in
 static block_sector_t byte_to_sector(const struct inode *inode, off_t pos) {
     ASSERT(inode != NULL);
     if (pos >= inode_length(inode)) return -1;
-    else return sector_at_inode_index(index_of_byte(pos), inode);
+    else return sector_at_inode_index(index_of_byte(pos), inode, NULL, NULL);
+}
+
+/*! As byte_to_sector(), but if the sector holding POS has yet to be
+    allocated, it is filled from DATA, a whole sector's worth, instead of
+    being zeroed first.  Sets *INITIALIZED to whether that happened, in
+    which case DATA is already in place. */
+static block_sector_t byte_to_sector_init(const struct inode *inode, off_t pos,
+                                          const void *data, bool *initialized) {
+    ASSERT(inode != NULL);
+    *initialized = false;
+    if (pos >= inode_length(inode)) return -1;
+    else return sector_at_inode_index(index_of_byte(pos), inode, data, initialized);
 }
 
 typedef void sector_action_func (block_sector_t);
@@ -276,6 +349,11 @@ struct inode * inode_open(block_sector_t sector) {
     inode->deny_write_cnt = 0;
     inode->removed = false;
     lock_init(&inode->extend_lock);
+    list_init(&inode->dirty_sectors);
+    inode->reserved_cnt = 0;
+#ifdef VM
+    inode->text_cached = false;
+#endif
     return inode;
 }
 
@@ -313,6 +391,11 @@ void inode_close(struct inode *inode) {
         if (inode->removed) {
             inode_apply_loaded(inode, sector_dealloc);
         }
+        buffer_disown(&inode->dirty_sectors);
+
+        /* Give back whatever is left of a reserved run. */
+        if (inode->reserved_cnt > 0)
+            free_map_release_multiple(inode->reserved_start, inode->reserved_cnt);
 
         free(inode); 
     }
@@ -362,9 +445,25 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
         bytes_read += chunk_size;
     }
 
+    /* Start fetching the sector that a sequential reader wants next. */
+    off_t next = ROUND_UP(offset, BLOCK_SECTOR_SIZE);
+    if (bytes_read > 0 && next < inode_length(inode))
+        buffer_read_ahead(byte_to_sector(inode, next));
+
     return bytes_read;
 }
 
+// Grows INODE so that it is at least NEW_LENGTH bytes long. Sectors in
+// the new region are allocated lazily as they are accessed.
+static void inode_extend(struct inode *inode, off_t new_length) {
+    lock_acquire(&inode->extend_lock);
+    if (inode_length(inode) < new_length) {
+        buffer_write_bytes_owned(inode->sector, offsetof(struct inode_data, length),
+                                 sizeof new_length, &new_length, &inode->dirty_sectors);
+    }
+    lock_release(&inode->extend_lock);
+}
+
 /*! Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
     Returns the number of bytes actually written, which may be
     less than SIZE if end of file is reached or an error occurs.
@@ -375,10 +474,21 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
 
     if (inode->deny_write_cnt)
         return 0;
+#ifdef VM
+    /* Cached pages of an executable must not outlive changes to it.
+       If it has started running since the check above, the write is
+       denied after all. */
+    if (inode->text_cached && !textcache_invalidate(inode))
+        return 0;
+#endif
+
+    /* Grow the file first, so that every sector we touch lies
+       within its length. */
+    if (size > 0)
+        inode_extend(inode, offset + size);
 
     while (size > 0) {
-        /* Sector to write, starting byte offset within sector. */
-        block_sector_t sector_idx = byte_to_sector(inode, offset);
+        /* Starting byte offset within sector. */
         int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
         /* Bytes left in sector. */
@@ -389,14 +499,18 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
         if (chunk_size <= 0)
             break;
 
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            buffer_write(sector_idx, buffer + bytes_written);
-        }
-        else {
-            /* Write partial sector directly to disk (cache). */
-            buffer_write_bytes(sector_idx, sector_ofs, chunk_size, buffer + bytes_written);
-        }
+        /* Sector to write.  A whole sector that has yet to be
+           allocated is filled with the data itself rather than zeroed
+           and then overwritten. */
+        bool initialized = false;
+        block_sector_t sector_idx = chunk_size == BLOCK_SECTOR_SIZE
+            ? byte_to_sector_init(inode, offset, buffer + bytes_written, &initialized)
+            : byte_to_sector(inode, offset);
+
+        /* Write directly to disk (cache). */
+        if (!initialized)
+            buffer_write_bytes_owned(sector_idx, sector_ofs, chunk_size,
+                                     buffer + bytes_written, &inode->dirty_sectors);
 
         /* Advance. */
         size -= chunk_size;
@@ -404,12 +518,63 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t
         bytes_written += chunk_size;
     }
     
-    buffer_mutate_member(inode->sector, struct inode_data, length, {
-        if (offset > length) length = offset;
-    });
     return bytes_written;
 }
 
+/*! Copies SIZE bytes from SRC, starting at SRC_OFS, into DST, starting at
+    DST_OFS.  The data moves directly between buffer cache entries, one
+    sector at a time.  Returns the number of bytes actually copied, which
+    may be less than SIZE if end of SRC is reached.  The two ranges must
+    not overlap if SRC and DST are the same inode. */
+off_t inode_copy_at(struct inode *dst, off_t dst_ofs,
+                    struct inode *src, off_t src_ofs, off_t size) {
+    off_t bytes_copied = 0;
+
+    if (dst->deny_write_cnt)
+        return 0;
+#ifdef VM
+    /* Cached pages of an executable must not outlive changes to it.
+       If it has started running since the check above, the write is
+       denied after all. */
+    if (dst->text_cached && !textcache_invalidate(dst))
+        return 0;
+#endif
+
+    off_t src_left = inode_length(src) - src_ofs;
+    if (size > src_left)
+        size = src_left;
+    if (size <= 0)
+        return 0;
+    inode_extend(dst, dst_ofs + size);
+
+    while (size > 0) {
+        /* Sectors to copy between, and the offsets within them. */
+        block_sector_t src_sector = byte_to_sector(src, src_ofs);
+        block_sector_t dst_sector = byte_to_sector(dst, dst_ofs);
+        int src_sector_ofs = src_ofs % BLOCK_SECTOR_SIZE;
+        int dst_sector_ofs = dst_ofs % BLOCK_SECTOR_SIZE;
+
+        /* Copy up to the nearer of the two sector ends. */
+        int src_left = BLOCK_SECTOR_SIZE - src_sector_ofs;
+        int dst_left = BLOCK_SECTOR_SIZE - dst_sector_ofs;
+        int chunk_size = src_left < dst_left ? src_left : dst_left;
+        if (size < chunk_size)
+            chunk_size = size;
+
+        buffer_copy_bytes(dst_sector, dst_sector_ofs,
+                          src_sector, src_sector_ofs, chunk_size,
+                          &dst->dirty_sectors);
+
+        /* Advance. */
+        size -= chunk_size;
+        src_ofs += chunk_size;
+        dst_ofs += chunk_size;
+        bytes_copied += chunk_size;
+    }
+
+    return bytes_copied;
+}
+
 /*! Disables writes to INODE.
     May be called at most once per inode opener. */
 void inode_deny_write (struct inode *inode) {
@@ -431,3 +596,28 @@ off_t inode_length(const struct inode *inode) {
     return buffer_read_member(inode->sector, struct inode_data, length);
 }
 
+/*! Reserves every sector needed to hold INODE's current length, data and
+    indirection sectors alike, as a single run of the free map.  The free
+    map is written once instead of once per sector.  Sectors are handed out
+    from the run as they are first written, so a file written front to back
+    ends up laid out sequentially.  Whatever is left of the run is given
+    back when INODE is closed for the last time.  Does nothing if no run is
+    large enough; sectors are then allocated one at a time as usual. */
+void inode_reserve(struct inode *inode) {
+    size_t data_cnt = bytes_to_sectors(inode_length(inode));
+
+    lock_acquire(&inode->extend_lock);
+    ASSERT(inode->reserved_cnt == 0);
+    size_t cnt = data_cnt + num_indirection_sectors(data_cnt);
+    if (cnt > 0 && free_map_allocate_multiple(cnt, &inode->reserved_start))
+        inode->reserved_cnt = cnt;
+    lock_release(&inode->extend_lock);
+}
+
+/*! Writes INODE's dirty data and indirection sectors back to disk in sector
+    order, followed by the inode itself.  Only sectors this inode dirtied
+    are visited, so the cost doesn't depend on the size of the cache. */
+void inode_sync(struct inode *inode) {
+    buffer_flush_owned(&inode->dirty_sectors);
+    buffer_flush_sector(inode->sector);
+}
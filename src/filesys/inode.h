@@ -70,6 +70,12 @@ struct inode {
     bool removed;                       /*!< True if deleted, false otherwise. */
     int deny_write_cnt;                 /*!< 0: writes ok, >0: deny writes. */
     struct lock extend_lock;                 /*!< Lock that must be acquired to extend. */
+    struct list dirty_sectors;          /*!< Cache entries dirtied through this inode. */
+    block_sector_t reserved_start;      /*!< Next sector of a reserved run. */
+    size_t reserved_cnt;                /*!< Sectors left in the reserved run. */
+#ifdef VM
+    bool text_cached;                   /*!< Has pages in the text cache. */
+#endif
 };
 
 void inode_init(void);
@@ -81,8 +87,12 @@ void inode_close(struct inode *);
 void inode_remove(struct inode *);
 off_t inode_read_at(struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at(struct inode *, const void *, off_t size, off_t offset);
+off_t inode_copy_at(struct inode *dst, off_t dst_ofs,
+                    struct inode *src, off_t src_ofs, off_t size);
 void inode_deny_write(struct inode *);
 void inode_allow_write(struct inode *);
 off_t inode_length(const struct inode *);
+void inode_reserve(struct inode *);
+void inode_sync(struct inode *);
 
 #endif /* filesys/inode.h */
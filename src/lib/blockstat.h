@@ -0,0 +1,43 @@
+/*! \file blockstat.h
+ *
+ * Per-device block I/O statistics returned by the blockstat() system call
+ * and printed at power off.  Shared between the kernel and user programs.
+ */
+
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+/*! Number of latency histogram buckets.  Bucket 0 counts requests that
+    took under 2**BLOCKSTAT_BUCKET_SHIFT CPU cycles from submission to
+    completion; bucket I > 0 counts those that took 2**(I + SHIFT - 1) up
+    to 2**(I + SHIFT) cycles; the last bucket also counts everything
+    slower. */
+#define BLOCKSTAT_BUCKETS 24
+#define BLOCKSTAT_BUCKET_SHIFT 10
+
+/*! Number of kinds of issuer, one per kernel block device type: kernel,
+    filesys, scratch, swap, raw, foreign. */
+#define BLOCKSTAT_ORIGINS 6
+
+/*! Maximum length of a block device name, as returned by blockname(). */
+#define BLOCKSTAT_NAME_MAX 15
+
+/*! Statistics for one block device. */
+struct blockstat {
+    unsigned long long read_cnt;        /*!< Read requests completed. */
+    unsigned long long write_cnt;       /*!< Write requests completed. */
+    unsigned long long read_bytes;      /*!< Bytes read. */
+    unsigned long long write_bytes;     /*!< Bytes written. */
+    unsigned long long sequential_cnt;  /*!< Requests that started where
+                                             the previous one ended. */
+    unsigned long long random_cnt;      /*!< All other requests. */
+    unsigned long long origin_cnt[BLOCKSTAT_ORIGINS]; /*!< Requests by the
+                                             type of device they were
+                                             submitted to. */
+    unsigned long long latency[BLOCKSTAT_BUCKETS];   /*!< Latency histogram. */
+    unsigned long long total_cycles;    /*!< Sum of all latencies. */
+    unsigned depth;                     /*!< Requests outstanding now. */
+    unsigned max_depth;                 /*!< Most ever outstanding. */
+};
+
+#endif /* lib/blockstat.h */
@@ -0,0 +1,21 @@
+/*! \file iovec.h
+ *
+ * Buffer descriptors for the vectored I/O system calls, readv() and
+ * writev().  Shared between the kernel and user programs.
+ */
+
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/*! Maximum number of buffers accepted by a single readv() or writev(). */
+#define IOV_MAX 64
+
+/*! One buffer of a vectored I/O request. */
+struct iovec {
+    void *iov_base;             /*!< Start of the buffer. */
+    size_t iov_len;             /*!< Size of the buffer in bytes. */
+};
+
+#endif /* lib/iovec.h */
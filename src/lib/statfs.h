@@ -0,0 +1,26 @@
+/*! \file statfs.h
+ *
+ * File system free space summary returned by the statfs() system call.
+ * Shared between the kernel and user programs.
+ */
+
+#ifndef __LIB_STATFS_H
+#define __LIB_STATFS_H
+
+#include <stddef.h>
+
+/*! Number of equal-sized groups the file system device is divided into
+    for the per-group free counts. */
+#define STATFS_GROUP_CNT 16
+
+/*! Free space on the file system, in sectors. */
+struct statfs {
+    size_t sector_size;                 /*!< Bytes per sector. */
+    size_t sector_cnt;                  /*!< Sectors on the device. */
+    size_t free_cnt;                    /*!< Sectors not in use. */
+    size_t largest_run_cnt;             /*!< Longest free run known of. */
+    size_t group_size;                  /*!< Sectors per group. */
+    size_t group_free_cnt[STATFS_GROUP_CNT]; /*!< Free sectors per group. */
+};
+
+#endif /* lib/statfs.h */
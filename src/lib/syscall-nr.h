@@ -34,7 +34,20 @@
     syscall_type(SYS_MKDIR,    sys_mkdir)    /*!< Create a directory. */                    \
     syscall_type(SYS_READDIR,  sys_readdir)  /*!< Reads a directory entry. */               \
     syscall_type(SYS_ISDIR,    sys_isdir)    /*!< Tests if a fd represents a directory. */  \
-    syscall_type(SYS_INUMBER,  sys_inumber)  /*!< Returns the inode number for a fd. */
+    syscall_type(SYS_INUMBER,  sys_inumber)  /*!< Returns the inode number for a fd. */  \
+                                                                                            \
+    /* Extensions. */                                                                       \
+    syscall_type(SYS_PREAD,    sys_pread)    /*!< Read from a file at a position. */        \
+    syscall_type(SYS_PWRITE,   sys_pwrite)   /*!< Write to a file at a position. */         \
+    syscall_type(SYS_READV,    sys_readv)    /*!< Read from a file into many buffers. */    \
+    syscall_type(SYS_WRITEV,   sys_writev)   /*!< Write to a file from many buffers. */  \
+    syscall_type(SYS_COPY_FILE_RANGE, sys_copy_file_range) /*!< Copy between files. */ \
+    syscall_type(SYS_FSYNC,    sys_fsync)    /*!< Write a file's data back to disk. */      \
+    syscall_type(SYS_SYNC,     sys_sync)     /*!< Write all cached data back to disk. */    \
+    syscall_type(SYS_STATFS,   sys_statfs)   /*!< Reports file system free space. */    \
+    syscall_type(SYS_BLOCKSTAT, sys_blockstat) /*!< Reports block device statistics. */ \
+    syscall_type(SYS_BLOCKNAME, sys_blockname) /*!< Names the Nth block device. */ \
+    syscall_type(SYS_FORK,     sys_fork)     /*!< Copy the current process. */
 
 /*! System call numbers. */
 #define syscall_type(type, handler) type,
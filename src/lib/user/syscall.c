@@ -1,9 +1,9 @@
 /*! \file syscall.c
  *
  * User-space wrappers for invoking system calls through the standard UNIX
- * APIs.  Four macros are defined, syscall0(), syscall1(), syscall2(), and
- * syscall3(), to pass the corresponding number of arguments to the system
- * call being invoked.  The remaining functions are wrappers for standard
+ * APIs.  Five macros are defined, syscall0(), syscall1(), syscall2(),
+ * syscall3(), and syscall4(), to pass the corresponding number of arguments
+ * to the system call being invoked.  The remaining functions are wrappers for standard
  * UNIX operations, which simply use the syscall macros to invoke the
  * system call.
  */
@@ -71,6 +71,25 @@
           retval;                                               \
         })
 
+/*! Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2, and
+    ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void halt(void) {
     syscall0(SYS_HALT);
     NOT_REACHED();
@@ -153,3 +172,46 @@ int inumber(int fd) {
     return syscall1(SYS_INUMBER, fd);
 }
 
+int pread(int fd, void *buffer, unsigned size, unsigned position) {
+    return syscall4(SYS_PREAD, fd, buffer, size, position);
+}
+
+int pwrite(int fd, const void *buffer, unsigned size, unsigned position) {
+    return syscall4(SYS_PWRITE, fd, buffer, size, position);
+}
+
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int copy_file_range(int fd_in, int fd_out, unsigned size) {
+    return syscall3(SYS_COPY_FILE_RANGE, fd_in, fd_out, size);
+}
+
+bool fsync(int fd) {
+    return syscall1(SYS_FSYNC, fd);
+}
+
+void sync(void) {
+    syscall0(SYS_SYNC);
+}
+
+bool statfs(struct statfs *buf) {
+    return syscall1(SYS_STATFS, buf);
+}
+
+bool blockstat(const char *device, struct blockstat *buf) {
+    return syscall2(SYS_BLOCKSTAT, device, buf);
+}
+
+bool blockname(unsigned index, char name[BLOCKSTAT_NAME_MAX + 1]) {
+    return syscall2(SYS_BLOCKNAME, index, name);
+}
+
+pid_t fork(void) {
+    return (pid_t) syscall0(SYS_FORK);
+}
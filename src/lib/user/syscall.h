@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <iovec.h>
+#include <statfs.h>
+#include <blockstat.h>
 
 /*! Process identifier. */
 typedef int pid_t;
@@ -45,5 +48,18 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+int pread(int fd, void *buffer, unsigned length, unsigned position);
+int pwrite(int fd, const void *buffer, unsigned length, unsigned position);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range(int fd_in, int fd_out, unsigned length);
+bool fsync(int fd);
+void sync(void);
+bool statfs(struct statfs *buf);
+bool blockstat(const char *device, struct blockstat *buf);
+bool blockname(unsigned index, char name[BLOCKSTAT_NAME_MAX + 1]);
+pid_t fork(void);
+
 #endif /* lib/user/syscall.h */
 
@@ -0,0 +1,53 @@
+/* Checks that blockstat() fails for a device that doesn't exist, and
+   that the request counts of the block devices go up as a file is
+   written and synced. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+/* Returns the requests completed so far by every block device that
+   blockname() reports. */
+static unsigned long long
+count_requests (void)
+{
+  char name[BLOCKSTAT_NAME_MAX + 1];
+  unsigned long long total = 0;
+  struct blockstat s;
+  unsigned i;
+
+  for (i = 0; blockname (i, name); i++)
+    {
+      if (!blockstat (name, &s))
+        fail ("blockstat \"%s\" failed", name);
+      if (s.depth > s.max_depth)
+        fail ("%s: %u requests outstanding, but at most %u ever",
+              name, s.depth, s.max_depth);
+      total += s.read_cnt + s.write_cnt;
+    }
+  if (i == 0)
+    fail ("blockname() found no block device");
+  return total;
+}
+
+void
+test_main (void)
+{
+  struct blockstat s;
+  unsigned long long before;
+  int fd;
+
+  CHECK (!blockstat ("nonexistent", &s),
+         "blockstat \"nonexistent\" (must return false)");
+
+  before = count_requests ();
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  msg ("sync");
+  sync ();
+  CHECK (count_requests () > before, "request counts went up");
+  close (fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blockstat) begin
+(blockstat) blockstat "nonexistent" (must return false)
+(blockstat) create "data"
+(blockstat) open "data"
+(blockstat) write "data"
+(blockstat) sync
+(blockstat) request counts went up
+(blockstat) end
+EOF
+pass;
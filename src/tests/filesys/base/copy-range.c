@@ -0,0 +1,61 @@
+/* Tests copy_file_range(): a copy from the middle of a file, a copy
+   that runs past the end of the source, and bad file descriptors. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SRC_SIZE 1000
+
+static char data[SRC_SIZE];
+static char buf[SRC_SIZE];
+
+void
+test_main (void)
+{
+  int src, dst;
+  size_t i;
+
+  for (i = 0; i < SRC_SIZE; i++)
+    data[i] = i % 251;
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src, data, SRC_SIZE) == SRC_SIZE, "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+
+  /* Copy part of the file, from the source's position. */
+  seek (src, 100);
+  CHECK (copy_file_range (src, dst, 300) == 300,
+         "copy 300 bytes from offset 100");
+  CHECK (tell (src) == 400 && tell (dst) == 300,
+         "both positions advanced by 300");
+
+  /* Copy more than is left in the source. */
+  seek (src, 900);
+  CHECK (copy_file_range (src, dst, 500) == 100,
+         "copy 500 bytes from offset 900 copies 100");
+  CHECK (copy_file_range (src, dst, 500) == 0,
+         "copy at end of \"src\" copies nothing");
+  CHECK (filesize (dst) == 400, "\"dst\" is 400 bytes");
+
+  seek (dst, 0);
+  CHECK (read (dst, buf, 400) == 400, "read \"dst\"");
+  compare_bytes (buf, data + 100, 300, 0, "dst");
+  compare_bytes (buf + 300, data + 900, 100, 300, "dst");
+
+  /* Bad file descriptors. */
+  CHECK (copy_file_range (src, 100, 10) == -1,
+         "copy to bad fd (must return -1)");
+  CHECK (copy_file_range (100, dst, 10) == -1,
+         "copy from bad fd (must return -1)");
+  CHECK (copy_file_range (0, dst, 10) == -1,
+         "copy from stdin (must return -1)");
+  CHECK (copy_file_range (src, 1, 10) == -1,
+         "copy to stdout (must return -1)");
+
+  close (src);
+  close (dst);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) open "src"
+(copy-range) write "src"
+(copy-range) create "dst"
+(copy-range) open "dst"
+(copy-range) copy 300 bytes from offset 100
+(copy-range) both positions advanced by 300
+(copy-range) copy 500 bytes from offset 900 copies 100
+(copy-range) copy at end of "src" copies nothing
+(copy-range) "dst" is 400 bytes
+(copy-range) read "dst"
+(copy-range) copy to bad fd (must return -1)
+(copy-range) copy from bad fd (must return -1)
+(copy-range) copy from stdin (must return -1)
+(copy-range) copy to stdout (must return -1)
+(copy-range) end
+EOF
+pass;
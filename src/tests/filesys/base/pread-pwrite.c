@@ -0,0 +1,59 @@
+/* Tests pread() and pwrite(): transfers at a given position leave the
+   file position alone, reads stop at end of file, and bad offsets and
+   file descriptors are rejected. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 1000
+
+static char data[FILE_SIZE];
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+  size_t i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    data[i] = i % 251;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  /* Write the second half first, then the first half. */
+  CHECK (pwrite (fd, data + 500, 500, 500) == 500,
+         "pwrite 500 bytes at offset 500");
+  CHECK (tell (fd) == 0, "position is still 0");
+  CHECK (pwrite (fd, data, 500, 0) == 500, "pwrite 500 bytes at offset 0");
+  CHECK (filesize (fd) == FILE_SIZE, "\"data\" is %d bytes", FILE_SIZE);
+
+  /* Read from the middle with the position somewhere else. */
+  seek (fd, 123);
+  CHECK (pread (fd, buf, 300, 400) == 300, "pread 300 bytes at offset 400");
+  CHECK (tell (fd) == 123, "position is still 123");
+  compare_bytes (buf, data + 400, 300, 400, "data");
+
+  /* Reads stop at end of file. */
+  CHECK (pread (fd, buf, 300, 900) == 100,
+         "pread 300 bytes at offset 900 reads 100");
+  compare_bytes (buf, data + 900, 100, 900, "data");
+  CHECK (pread (fd, buf, 10, FILE_SIZE) == 0,
+         "pread at end of file reads nothing");
+
+  /* Bad offsets and file descriptors. */
+  CHECK (pread (fd, buf, 10, -1) == -1,
+         "pread at negative offset (must return -1)");
+  CHECK (pwrite (fd, data, 10, -1) == -1,
+         "pwrite at negative offset (must return -1)");
+  CHECK (pread (100, buf, 10, 0) == -1, "pread from bad fd (must return -1)");
+  CHECK (pwrite (100, data, 10, 0) == -1, "pwrite to bad fd (must return -1)");
+  CHECK (pread (0, buf, 10, 0) == -1, "pread from stdin (must return -1)");
+  CHECK (pwrite (1, data, 10, 0) == -1, "pwrite to stdout (must return -1)");
+  CHECK (filesize (fd) == FILE_SIZE, "\"data\" is still %d bytes", FILE_SIZE);
+
+  close (fd);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) pwrite 500 bytes at offset 500
+(pread-pwrite) position is still 0
+(pread-pwrite) pwrite 500 bytes at offset 0
+(pread-pwrite) "data" is 1000 bytes
+(pread-pwrite) pread 300 bytes at offset 400
+(pread-pwrite) position is still 123
+(pread-pwrite) pread 300 bytes at offset 900 reads 100
+(pread-pwrite) pread at end of file reads nothing
+(pread-pwrite) pread at negative offset (must return -1)
+(pread-pwrite) pwrite at negative offset (must return -1)
+(pread-pwrite) pread from bad fd (must return -1)
+(pread-pwrite) pwrite to bad fd (must return -1)
+(pread-pwrite) pread from stdin (must return -1)
+(pread-pwrite) pwrite to stdout (must return -1)
+(pread-pwrite) "data" is still 1000 bytes
+(pread-pwrite) end
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Passes an invalid iovec array to the readv system call.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int fd;
+  CHECK (create ("data", 10), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  readv (fd, (struct iovec *) 0xc0100000, 1);
+  fail ("should not have survived readv()");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-bad-iov) begin
+(readv-bad-iov) create "data"
+(readv-bad-iov) open "data"
+readv-bad-iov: exit(-1)
+EOF
+pass;
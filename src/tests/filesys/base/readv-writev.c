@@ -0,0 +1,72 @@
+/* Tests readv() and writev(): data moves through the buffers in order,
+   reads stop at end of file, the console works, and bad buffer counts
+   and file descriptors are rejected. */
+
+#include <iovec.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[64];
+
+void
+test_main (void)
+{
+  static char hello[] = "hello, ";
+  static char world[] = "world";
+  static char line[] = "(readv-writev) writev to console\n";
+  struct iovec out[2] = { { hello, 7 }, { world, 5 } };
+  struct iovec in[3] = { { buf, 3 }, { buf + 3, 6 }, { buf + 9, 20 } };
+  struct iovec console[2] = { { line, 15 }, { line + 15, sizeof line - 16 } };
+  struct iovec many[IOV_MAX + 1];
+  int fd;
+  int i;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  CHECK (writev (fd, out, 2) == 12, "writev 2 buffers");
+  CHECK (tell (fd) == 12, "position advanced by 12");
+
+  /* The last buffer is only partly filled. */
+  seek (fd, 0);
+  CHECK (readv (fd, in, 3) == 12, "readv 3 buffers reads 12 bytes");
+  compare_bytes (buf, "hello, world", 12, 0, "data");
+  CHECK (readv (fd, in, 3) == 0, "readv at end of file reads nothing");
+
+  /* The console. */
+  CHECK (writev (STDOUT_FILENO, console, 2) == (int) sizeof line - 1,
+         "writev to console returns %d", (int) sizeof line - 1);
+  CHECK (readv (STDIN_FILENO, in, 0) == 0,
+         "readv no buffers from console reads nothing");
+
+  /* Buffer counts. */
+  CHECK (readv (fd, in, 0) == 0, "readv no buffers reads nothing");
+  CHECK (writev (fd, out, 0) == 0, "writev no buffers writes nothing");
+  CHECK (readv (fd, in, -1) == -1,
+         "readv negative buffer count (must return -1)");
+  for (i = 0; i < IOV_MAX + 1; i++)
+    {
+      many[i].iov_base = buf;
+      many[i].iov_len = 1;
+    }
+  CHECK (writev (fd, many, IOV_MAX) == IOV_MAX,
+         "writev %d buffers", IOV_MAX);
+  CHECK (writev (fd, many, IOV_MAX + 1) == -1,
+         "writev %d buffers (must return -1)", IOV_MAX + 1);
+  CHECK (readv (fd, many, IOV_MAX + 1) == -1,
+         "readv %d buffers (must return -1)", IOV_MAX + 1);
+
+  /* Bad file descriptors. */
+  CHECK (readv (100, in, 3) == -1, "readv from bad fd (must return -1)");
+  CHECK (writev (100, out, 2) == -1, "writev to bad fd (must return -1)");
+  CHECK (readv (STDOUT_FILENO, in, 3) == -1,
+         "readv from stdout (must return -1)");
+  CHECK (writev (STDIN_FILENO, out, 2) == -1,
+         "writev to stdin (must return -1)");
+  CHECK (filesize (fd) == 12 + IOV_MAX, "\"data\" is %d bytes", 12 + IOV_MAX);
+
+  close (fd);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev 2 buffers
+(readv-writev) position advanced by 12
+(readv-writev) readv 3 buffers reads 12 bytes
+(readv-writev) readv at end of file reads nothing
+(readv-writev) writev to console returns 33
+(readv-writev) writev to console
+(readv-writev) readv no buffers from console reads nothing
+(readv-writev) readv no buffers reads nothing
+(readv-writev) writev no buffers writes nothing
+(readv-writev) readv negative buffer count (must return -1)
+(readv-writev) writev 64 buffers
+(readv-writev) writev 65 buffers (must return -1)
+(readv-writev) readv 65 buffers (must return -1)
+(readv-writev) readv from bad fd (must return -1)
+(readv-writev) writev to bad fd (must return -1)
+(readv-writev) readv from stdout (must return -1)
+(readv-writev) writev to stdin (must return -1)
+(readv-writev) "data" is 76 bytes
+(readv-writev) end
+EOF
+pass;
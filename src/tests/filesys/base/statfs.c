@@ -0,0 +1,41 @@
+/* Checks that statfs() reports sensible totals, and that the free
+   count drops as a file is written and goes back up once the file is
+   removed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[8192];
+
+/* Returns the free sector count, checking the totals along the way. */
+static size_t
+free_sectors (void)
+{
+  struct statfs s;
+
+  if (!statfs (&s))
+    fail ("statfs() failed");
+  if (s.sector_size != 512)
+    fail ("sector size is %zu, not 512", s.sector_size);
+  if (s.free_cnt > s.sector_cnt)
+    fail ("%zu sectors free out of %zu", s.free_cnt, s.sector_cnt);
+  return s.free_cnt;
+}
+
+void
+test_main (void)
+{
+  size_t before, written;
+  int fd;
+
+  before = free_sectors ();
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  written = free_sectors ();
+  CHECK (written < before, "free count dropped");
+  close (fd);
+  CHECK (remove ("data"), "remove \"data\"");
+  CHECK (free_sectors () > written, "free count went back up");
+}
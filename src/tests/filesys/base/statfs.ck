@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(statfs) begin
+(statfs) create "data"
+(statfs) open "data"
+(statfs) write "data"
+(statfs) free count dropped
+(statfs) remove "data"
+(statfs) free count went back up
+(statfs) end
+EOF
+pass;
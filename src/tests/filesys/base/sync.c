@@ -0,0 +1,29 @@
+/* Writes a file, syncs it with fsync() and sync(), and checks that
+   the calls return and the data reads back. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void
+test_main (void)
+{
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  CHECK (fsync (fd), "fsync \"data\"");
+  CHECK (!fsync (100), "fsync bad fd (must return false)");
+  CHECK (!fsync (1), "fsync stdout (must return false)");
+  close (fd);
+  msg ("sync");
+  sync ();
+  check_file ("data", buf, sizeof buf);
+}
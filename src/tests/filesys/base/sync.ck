@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sync) begin
+(sync) create "data"
+(sync) open "data"
+(sync) write "data"
+(sync) fsync "data"
+(sync) fsync bad fd (must return false)
+(sync) fsync stdout (must return false)
+(sync) sync
+(sync) open "data" for verification
+(sync) verified contents of "data"
+(sync) close "data"
+(sync) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Forks with a few pages of data, then has both processes write to
+   them, and checks that neither sees the other's writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096)
+
+static char buf[SIZE];
+
+/* Fails unless BUF[OFS, OFS + SIZE) still has the original pattern. */
+static void
+check_pattern (size_t ofs, size_t size, const char *who)
+{
+  size_t i;
+
+  for (i = ofs; i < ofs + size; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("%s: byte %zu is %02hhx instead of %02hhx",
+            who, i, buf[i], (char) (i % 251));
+}
+
+void
+test_main (void)
+{
+  size_t i;
+  pid_t pid;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Whenever the parent writes, we must not see it. */
+      check_pattern (0, SIZE, "child");
+      memset (buf, 'c', SIZE);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'c')
+          fail ("child: lost its own write at byte %zu", i);
+      msg ("child: writes are private");
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork() returned %d", pid);
+
+  /* Write to the first page only, while the child may still be
+     sharing it. */
+  memset (buf, 'p', 4096);
+
+  if (wait (pid) != 0)
+    fail ("child failed");
+  for (i = 0; i < 4096; i++)
+    if (buf[i] != 'p')
+      fail ("parent: lost its own write at byte %zu", i);
+  check_pattern (4096, SIZE - 4096, "parent");
+  msg ("parent: writes are private");
+}
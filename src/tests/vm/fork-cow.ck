@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) child: writes are private
+fork-cow: exit(0)
+(fork-cow) parent: writes are private
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
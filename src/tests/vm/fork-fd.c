@@ -0,0 +1,44 @@
+/* Reads part of a file, forks, and checks that the child can keep
+   reading the file from the same position.  Each process then has a
+   position of its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SKIP 10
+#define CHUNK 20
+
+void
+test_main (void)
+{
+  char buf[CHUNK];
+  int handle;
+  pid_t pid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, SKIP) == SKIP, "read first %d bytes", SKIP);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      CHECK (tell (handle) == SKIP, "child: tell(fd) = %d", SKIP);
+      CHECK (read (handle, buf, CHUNK) == CHUNK,
+             "child: read %d more bytes", CHUNK);
+      if (memcmp (buf, sample + SKIP, CHUNK))
+        fail ("child: read wrong data");
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork() returned %d", pid);
+
+  CHECK (wait (pid) == 0, "wait for child");
+  CHECK (tell (handle) == SKIP, "parent: tell(fd) = %d", SKIP);
+  CHECK (read (handle, buf, CHUNK) == CHUNK,
+         "parent: read %d more bytes", CHUNK);
+  if (memcmp (buf, sample + SKIP, CHUNK))
+    fail ("parent: read wrong data");
+  close (handle);
+}
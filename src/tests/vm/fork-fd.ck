@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-fd) begin
+(fork-fd) open "sample.txt"
+(fork-fd) read first 10 bytes
+(fork-fd) child: tell(fd) = 10
+(fork-fd) child: read 20 more bytes
+fork-fd: exit(0)
+(fork-fd) wait for child
+(fork-fd) parent: tell(fd) = 10
+(fork-fd) parent: read 20 more bytes
+(fork-fd) end
+fork-fd: exit(0)
+EOF
+pass;
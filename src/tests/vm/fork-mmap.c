@@ -0,0 +1,40 @@
+/* Maps a file and forks.  The child must see the mapping it
+   inherited, and be able to map the file again itself. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char *inherited = (char *) 0x10000000;
+  char *own = (char *) 0x20000000;
+  int handle;
+  mapid_t map;
+  pid_t pid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, inherited) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      CHECK (!memcmp (inherited, sample, strlen (sample)),
+             "child: inherited mapping has the file's data");
+      CHECK ((map = mmap (handle, own)) != MAP_FAILED,
+             "child: mmap \"sample.txt\" again");
+      CHECK (!memcmp (own, sample, strlen (sample)),
+             "child: new mapping has the file's data");
+      munmap (map);
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork() returned %d", pid);
+
+  CHECK (wait (pid) == 0, "wait for child");
+  CHECK (!memcmp (inherited, sample, strlen (sample)),
+         "parent: mapping still has the file's data");
+}
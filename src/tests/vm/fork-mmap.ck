@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-mmap) begin
+(fork-mmap) open "sample.txt"
+(fork-mmap) mmap "sample.txt"
+(fork-mmap) child: inherited mapping has the file's data
+(fork-mmap) child: mmap "sample.txt" again
+(fork-mmap) child: new mapping has the file's data
+fork-mmap: exit(0)
+(fork-mmap) wait for child
+(fork-mmap) parent: mapping still has the file's data
+(fork-mmap) end
+fork-mmap: exit(0)
+EOF
+pass;
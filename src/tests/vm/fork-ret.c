@@ -0,0 +1,22 @@
+/* Forks and checks that the child sees fork() return 0 while
+   the parent gets the child's pid, which it can wait for. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      msg ("child: fork() returned 0");
+      exit (81);
+    }
+  if (pid < 0)
+    fail ("fork() returned %d", pid);
+
+  /* Only print once the child is done, to keep the output in order. */
+  msg ("parent: wait(fork()) = %d", wait (pid));
+}
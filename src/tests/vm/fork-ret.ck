@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-ret) begin
+(fork-ret) child: fork() returned 0
+fork-ret: exit(81)
+(fork-ret) parent: wait(fork()) = 81
+(fork-ret) end
+fork-ret: exit(0)
+EOF
+pass;
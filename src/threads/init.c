@@ -41,12 +41,22 @@
 
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
 #include "filesys/buffer.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 
 #endif
 
+#ifdef VM
+#include "vm/cow.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/text.h"
+#endif
+
 /*! Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
@@ -66,6 +76,23 @@ static const char *swap_bdev_name;
 /*! -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/*! Most boot phases that boot_phase_done() can record. */
+#define MAX_BOOT_PHASES 16
+
+/*! A boot phase and the TSC reading when it ended. */
+struct boot_phase {
+    const char *name;           /*!< Phase name. */
+    uint64_t end_cycles;        /*!< timer_cycles() at its end. */
+};
+
+/*! Boot phases so far, in order, for print_boot_phases(). */
+static struct boot_phase boot_phases[MAX_BOOT_PHASES];
+static size_t boot_phase_cnt;
+static uint64_t boot_start_cycles;
+
+static void boot_phase_done(const char *name);
+static void print_boot_phases(void);
+
 static void bss_init(void);
 static void paging_init(void);
 
@@ -87,10 +114,12 @@ int main(void) {
 
     /* Clear BSS. */  
     bss_init();
+    boot_start_cycles = timer_cycles();
 
     /* Break command line into arguments and parse options. */
     argv = read_command_line();
     argv = parse_options(argv);
+    boot_phase_done("command line");
 
     /* Initialize ourselves as a thread so we can use locks,
        then enable console locking. */
@@ -105,6 +134,7 @@ int main(void) {
     palloc_init(user_page_limit);
     malloc_init();
     paging_init();
+    boot_phase_done("memory");
 
     /* Segmentation. */
 #ifdef USERPROG
@@ -121,20 +151,45 @@ int main(void) {
     exception_init();
     syscall_init();
 #endif
+    boot_phase_done("interrupts");
 
     /* Start thread scheduler and enable interrupts. */
     thread_start();
     serial_init_queue();
+    boot_phase_done("scheduler");
     timer_calibrate();
+    boot_phase_done("timer calibration");
 
 #ifdef FILESYS
-    /* Initialize file system. */
+    /* Initialize file system.  RAM disks come first so that they take
+       their roles ahead of any disk partitions. */
+    ramdisk_init();
+    boot_phase_done("RAM disks");
     ide_init();
+    boot_phase_done("IDE probe");
+    virtio_blk_init();
+    boot_phase_done("virtio probe");
+    stripe_init();
     locate_block_devices();
     buffer_init();
+    boot_phase_done("block roles, cache");
+#ifdef VM
+    /* Every file write checks the text cache for stale pages. */
+    textcache_init();
+#endif
     filesys_init(format_filesys);
+    boot_phase_done("file system");
 #endif
 
+#ifdef VM
+    /* Initialize virtual memory, now that the swap device is known. */
+    frametable_init();
+    swaptable_init();
+    cow_init();
+    boot_phase_done("virtual memory");
+#endif
+
+    print_boot_phases();
     printf("Boot complete.\n");
 
     /* Run actions specified on kernel command line. */
@@ -145,6 +200,35 @@ int main(void) {
     thread_exit();
 }
 
+/*! Records that boot phase NAME, which started when the previous one
+    ended, is over. */
+static void boot_phase_done(const char *name) {
+    if (boot_phase_cnt < MAX_BOOT_PHASES) {
+        boot_phases[boot_phase_cnt].name = name;
+        boot_phases[boot_phase_cnt].end_cycles = timer_cycles();
+        boot_phase_cnt++;
+    }
+}
+
+/*! Prints how long each boot phase took, in TSC cycles and, if timer
+    calibration measured the TSC rate, in microseconds. */
+static void print_boot_phases(void) {
+    uint64_t hz = timer_cycles_per_second();
+    uint64_t start = boot_start_cycles;
+    size_t i;
+
+    printf("Boot phases:\n");
+    for (i = 0; i < boot_phase_cnt; i++) {
+        uint64_t cycles = boot_phases[i].end_cycles - start;
+
+        printf("  %-20s %'14"PRIu64" cycles", boot_phases[i].name, cycles);
+        if (hz != 0)
+            printf(" %'10"PRIu64" us", cycles * 1000000 / hz);
+        printf("\n");
+        start = boot_phases[i].end_cycles;
+    }
+}
+
 /*! Clear the "BSS", a segment that should be initialized to
     zeros.  It isn't actually stored on disk or zeroed by the
     kernel loader, so we have to zero it ourselves.
@@ -243,6 +327,10 @@ static char ** parse_options(char **argv) {
             filesys_bdev_name = value;
         else if (!strcmp(name, "-scratch"))
             scratch_bdev_name = value;
+        else if (!strcmp(name, "-ramdisk"))
+            ramdisk_configure(value);
+        else if (!strcmp(name, "-stripe"))
+            stripe_configure(value);
 #ifdef VM
         else if (!strcmp(name, "-swap"))
             swap_bdev_name = value;
@@ -250,6 +338,8 @@ static char ** parse_options(char **argv) {
 #endif
         else if (!strcmp(name, "-rs"))
             random_init(atoi(value));
+        else if (!strcmp(name, "-loops"))
+            timer_configure_calibration(value);
         else if (!strcmp(name, "-mlfqs"))
             thread_mlfqs = true;
 #ifdef USERPROG
@@ -363,11 +453,17 @@ static void usage(void) {
            "  -f                 Format file system device during startup.\n"
            "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
            "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+           "  -ramdisk=ROLE:KB   Create a KB kB RAM disk for ROLE (filesys,\n"
+           "                     scratch, or swap).\n"
+           "  -stripe=ROLE:DEV,DEV[,...][:CHUNK]\n"
+           "                     Stripe ROLE across DEVs in CHUNK-sector chunks.\n"
 #ifdef VM
            "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
            "  -rs=SEED           Set random number seed to SEED.\n"
+           "  -loops=N           Skip timer calibration and use N loops/s,\n"
+           "                     as printed by an earlier boot.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
@@ -398,6 +494,10 @@ static void locate_block_device(enum block_type role, const char *name) {
         if (block == NULL)
             PANIC("No such block device \"%s\"", name);
     }
+    else if (block_get_role(role) != NULL) {
+        /* Already claimed, e.g. by a stripe. */
+        block = block_get_role(role);
+    }
     else {
         for (block = block_first(); block != NULL; block = block_next(block)) {
             if (block_type(block) == role)
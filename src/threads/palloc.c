@@ -135,6 +135,27 @@ void palloc_free_page(void *page) {
     palloc_free_multiple(page, 1);
 }
 
+/*! Returns the first page of the user pool.  Its pages are contiguous. */
+void *palloc_user_pool_base(void) {
+    return user_pool.base;
+}
+
+/*! Returns the number of pages in the user pool. */
+size_t palloc_user_page_cnt(void) {
+    return bitmap_size(user_pool.used_map);
+}
+
+/*! Returns the number of pages in the user pool not currently allocated. */
+size_t palloc_user_free_cnt(void) {
+    size_t cnt;
+
+    lock_acquire(&user_pool.lock);
+    cnt = bitmap_count(user_pool.used_map, 0, bitmap_size(user_pool.used_map),
+                       false);
+    lock_release(&user_pool.lock);
+    return cnt;
+}
+
 /*! Initializes pool P as starting at START and ending at END,
     naming it NAME for debugging purposes. */
 static void init_pool(struct pool *p, void *base, size_t page_cnt,
@@ -7,6 +7,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "synch.h"
@@ -33,6 +34,9 @@ typedef int tid_t;
 /* file descriptor table size */
 #define MAX_OPEN_FILES 128
 
+/* memory mapping table size */
+#define MAX_MAPPED_FILES 32
+
 /*! A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -135,6 +139,19 @@ struct thread {
     /**@{*/
 #endif
 
+#ifdef VM
+    /*! Owned by vm/page.c and syscall.c. */
+    /**@{*/
+    struct hash pagetable;              /*!< Supplementary page table. */
+    struct lock pagetable_lock;         /*!< Held to load, evict, install or
+                                             uninstall pages. */
+    struct page_info *mapped_files[MAX_MAPPED_FILES]; /*!< First page of each
+                                                           mapping, by mapid. */
+    void *user_esp;                     /*!< User stack pointer on entry to
+                                             the current system call. */
+    /**@}*/
+#endif
+
     struct dir* directory;       /* This process' current directory */
                                  /* Notably, this is NULL when the current dir is root */
 
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /*! Number of page faults processed. */
 static long long page_fault_cnt;
@@ -134,9 +138,55 @@ static void page_fault(struct intr_frame *f) {
     write = (f->error_code & PF_W) != 0;
     user = (f->error_code & PF_U) != 0;
 
-    /* To implement virtual memory, delete the rest of the function
-       body, and replace it with code that brings in the page to
-       which fault_addr refers. */
+#ifdef VM
+    /* Bring in the page if the process has set one up at FAULT_ADDR, or
+       grow the stack down to it if it looks like a push.  This covers
+       the kernel reading system call arguments off the user stack too,
+       before it takes any locks; the user's stack pointer is then the one
+       saved on entry to the system call.  Buffers are pinned before the
+       kernel touches them, so it never faults on those.  Writes to a page
+       shared copy-on-write after a fork fault too, and get the process
+       its own copy. */
+    struct thread *t = thread_current();
+    if ((not_present || write) && is_user_vaddr(fault_addr) &&
+        t->pagedir != NULL) {
+        void *esp = user ? f->esp : t->user_esp;
+        bool resolved = false;
+
+        /* The lock keeps the page from being evicted under us, and makes
+           us wait if it's being evicted right now. */
+        lock_acquire(&t->pagetable_lock);
+        struct page_info *page =
+            pagetable_info_for_address(&t->pagetable, fault_addr);
+        if (page != NULL && page->shared.cow != NULL &&
+            page->writable && write) {
+            pagetable_write_page(page);
+            resolved = true;
+        }
+        else if (!not_present) {
+            /* A real write to a read-only page.  Not ours to fix. */
+        }
+        else if (page != NULL && page->state != LOADED_STATE &&
+                 (page->writable || !write)) {
+            pagetable_load_page(page);
+            resolved = true;
+        }
+        else if (page != NULL && page->state == LOADED_STATE) {
+            /* Someone else brought it back in while we waited. */
+            resolved = true;
+        }
+        else if (page == NULL && pagetable_is_stack_access(fault_addr, esp)) {
+            pagetable_install_and_load_allocation(&t->pagetable,
+                                                  pg_round_down(fault_addr));
+            resolved = true;
+        }
+        lock_release(&t->pagetable_lock);
+
+        if (resolved)
+            return;
+    }
+#endif
+
     printf("Page fault at %p: %s error %s page in %s context.\n",
            fault_addr,
            not_present ? "not present" : "rights violation",
@@ -11,6 +11,7 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd(void);
 static void invalidate_pagedir(uint32_t *);
@@ -141,6 +142,33 @@ void pagedir_clear_page(uint32_t *pd, void *upage) {
     }
 }
 
+/*! Maps user virtual page UPAGE to the frame at kernel virtual address KPAGE
+    in the running process's page directory.  UPAGE must not already be
+    present.  Panics if a page table cannot be allocated for UPAGE. */
+void pagedir_install_page(void *upage, void *kpage, bool writable) {
+    if (!pagedir_set_page(thread_current()->pagedir, upage, kpage, writable))
+        PANIC("Unable to allocate a page table.");
+}
+
+/*! Marks user virtual page UPAGE not present in page directory PD and
+    returns the kernel virtual address of the frame it was mapped to.  UPAGE
+    must be present.  The accessed and dirty bits are kept, so they may still
+    be examined afterward. */
+void *pagedir_uninstall_page(uint32_t *pd, void *upage) {
+    void *kpage = pagedir_get_page(pd, upage);
+
+    ASSERT(kpage != NULL);
+    pagedir_clear_page(pd, upage);
+    return kpage;
+}
+
+/*! Returns true if the PTE for virtual page VPAGE in PD is present and lets
+    user code write to the page. */
+bool pagedir_is_writable(uint32_t *pd, const void *vpage) {
+    uint32_t *pte = lookup_page(pd, vpage, false);
+    return pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_W) != 0;
+}
+
 /*! Returns true if the PTE for virtual page VPAGE in PD is dirty, that is, if
     the page has been modified since the PTE was installed.
     Returns false if PD contains no PTE for VPAGE. */
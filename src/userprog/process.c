@@ -14,9 +14,13 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load(const char *cmdline, void (**eip)(void), void **esp);
@@ -80,6 +84,111 @@ static void start_process(void *file_name_) {
     NOT_REACHED();
 }
 
+#ifdef VM
+/*! What a forked child needs from its parent to start. */
+struct fork_info {
+    struct thread *parent;              /*!< The process forking. */
+    struct intr_frame if_;              /*!< Its registers at the fork. */
+};
+
+static thread_func start_fork NO_RETURN;
+
+/*! Starts a new thread running a copy of the current process, which is in
+    the system call whose interrupt frame is F.  The copy shares the
+    process's memory copy-on-write.  The parent must wait for the child to
+    load before it returns to user code.  Returns the new process's thread
+    id, or TID_ERROR if the thread cannot be created. */
+tid_t process_fork(struct intr_frame *f) {
+    struct fork_info *info;
+    tid_t tid;
+
+    info = malloc(sizeof(struct fork_info));
+    if (info == NULL)
+        return TID_ERROR;
+    info->parent = thread_current();
+    info->if_ = *f;
+
+    tid = thread_create(thread_current()->name, PRI_DEFAULT, start_fork, info);
+    if (tid == TID_ERROR)
+        free(info);
+    return tid;
+}
+
+/*! A thread function that copies the parent process and starts it running
+    from the parent's system call, returning 0. */
+static void start_fork(void *info_) {
+    struct fork_info *info = info_;
+    struct thread *parent = info->parent;
+    struct thread *t = thread_current();
+    struct intr_frame if_ = info->if_;
+    int i;
+
+    free(info);
+
+    /* Set up the supplementary page table ahead of the page directory, as
+       load() does. */
+    hash_init(&t->pagetable, page_hash, page_less, NULL);
+    lock_init(&t->pagetable_lock);
+
+    /* Allocate and activate page directory. */
+    t->pagedir = pagedir_create();
+    if (t->pagedir == NULL)
+        goto fail;
+    process_activate();
+
+    /* Keep our own handle on the executable, denying writes to it. */
+    t->executable_file = file_reopen(parent->executable_file);
+    if (t->executable_file == NULL)
+        goto fail;
+    file_deny_write(t->executable_file);
+
+    /* Copy the parent's pages.  Its lock keeps its pages from being
+       evicted while we share them; nothing else can touch either table,
+       since the parent is waiting for us. */
+    lock_acquire(&parent->pagetable_lock);
+    lock_acquire(&t->pagetable_lock);
+    pagetable_fork(&t->pagetable, &parent->pagetable, parent->pagedir,
+                   t->executable_file);
+    for (i = 0; i < MAX_MAPPED_FILES; i++) {
+        if (parent->mapped_files[i] != NULL) {
+            t->mapped_files[i] = pagetable_info_for_address(&t->pagetable,
+                parent->mapped_files[i]->virtual_address);
+        }
+    }
+    lock_release(&t->pagetable_lock);
+    lock_release(&parent->pagetable_lock);
+
+    /* Open the parent's files again, at the same positions. */
+    for (i = 0; i < MAX_OPEN_FILES; i++) {
+        struct file *file = parent->file_descriptors[i];
+        if (file != NULL) {
+            t->file_descriptors[i] = file_reopen(file);
+            if (t->file_descriptors[i] != NULL)
+                file_seek(t->file_descriptors[i], file_tell(file));
+        }
+    }
+
+    /* Start out in the parent's current directory. */
+    if (parent->directory != NULL)
+        t->directory = dir_reopen(parent->directory);
+
+    // Let parent know that we're done copying it.
+    t->load_status = 0;
+    sema_up(&(t->loaded));
+
+    /* Return to user code from the parent's system call, as the child. */
+    if_.eax = 0;
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED();
+
+fail:
+    // Let parent know that we failed copying it.
+    t->load_status = -1;
+    sema_up(&(t->loaded));
+    thread_exit();
+}
+#endif
+
 /*! Waits for thread TID to die and returns its exit status.  If it was
     terminated by the kernel (i.e. killed due to an exception), returns -1.
     If TID is invalid or if it was not a child of the calling process, or if
@@ -117,6 +226,20 @@ void process_exit(void) {
     struct thread *cur = thread_current();
     uint32_t *pd;
 
+#ifdef VM
+    /* Release every page the process has set up, writing dirty mapped
+       pages back to their files, while its page directory is still
+       around to say which pages are dirty. */
+    if (cur->pagedir != NULL) {
+        lock_acquire(&cur->pagetable_lock);
+        pagetable_uninstall_all(&cur->pagetable);
+        lock_release(&cur->pagetable_lock);
+        hash_destroy(&cur->pagetable, NULL);
+    }
+#endif
+
+    /* Only now that none of its pages are mapped may the executable be
+       written again. */
     file_close(cur->executable_file);
 
     /* Destroy the current process's page directory and switch back
@@ -239,6 +362,13 @@ bool load(const char *file_name, void (**eip) (void), void **esp) {
     program_name = strtok_r(file_name_copy, " ", &saveptr);  // First token is the program name
     strlcpy(t->name, program_name, 16);
 
+#ifdef VM
+    /* Set up the supplementary page table ahead of the page directory, so
+       that it exists whenever a page directory does. */
+    hash_init(&t->pagetable, page_hash, page_less, NULL);
+    lock_init(&t->pagetable_lock);
+#endif
+
     /* Allocate and activate page directory. */
     t->pagedir = pagedir_create();
     if (t->pagedir == NULL)
@@ -409,7 +539,9 @@ done:
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void *upage, void *kpage, bool writable);
+#endif
 
 /*! Checks whether PHDR describes a valid, loadable segment in
     FILE and returns true if so, false otherwise. */
@@ -473,6 +605,12 @@ static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(ofs % PGSIZE == 0);
 
+#ifdef VM
+    /* Leave each page to be read in or zeroed when it's first touched. */
+    pagetable_install_segment(&thread_current()->pagetable, file, ofs,
+                              read_bytes, zero_bytes, writable, upage);
+    return true;
+#else
     file_seek(file, ofs);
     while (read_bytes > 0 || zero_bytes > 0) {
         /* Calculate how to fill this page.
@@ -505,11 +643,20 @@ static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
         upage += PGSIZE;
     }
     return true;
+#endif
 }
 
 /*! Create a minimal stack by mapping a zeroed page at the top of
     user virtual memory. */
 static bool setup_stack(void **esp) {
+#ifdef VM
+    /* Pushing the arguments faults the page in, and the stack grows
+       from there on demand. */
+    pagetable_install_allocation(&thread_current()->pagetable,
+                                 ((uint8_t *) PHYS_BASE) - PGSIZE);
+    *esp = PHYS_BASE;
+    return true;
+#else
     uint8_t *kpage;
     bool success = false;
 
@@ -522,6 +669,7 @@ static bool setup_stack(void **esp) {
             palloc_free_page(kpage);
     }
     return success;
+#endif
 }
 
 /*! Adds a mapping from user virtual address UPAGE to kernel
@@ -533,6 +681,7 @@ static bool setup_stack(void **esp) {
     with palloc_get_page().
     Returns true on success, false if UPAGE is already mapped or
     if memory allocation fails. */
+#ifndef VM
 static bool install_page(void *upage, void *kpage, bool writable) {
     struct thread *t = thread_current();
 
@@ -541,3 +690,4 @@ static bool install_page(void *upage, void *kpage, bool writable) {
     return (pagedir_get_page(t->pagedir, upage) == NULL &&
             pagedir_set_page(t->pagedir, upage, kpage, writable));
 }
+#endif
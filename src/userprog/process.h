@@ -1,9 +1,13 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 
 tid_t process_execute(const char *file_name);
+#ifdef VM
+tid_t process_fork(struct intr_frame *f);
+#endif
 int process_wait(tid_t);
 void process_exit(void);
 void process_activate(void);
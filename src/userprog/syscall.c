@@ -10,8 +10,15 @@
 #include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/buffer.h"
+#include "filesys/free-map.h"
+#include "devices/block.h"
 #include "devices/input.h"
+#include <iovec.h>
 #include "process.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void syscall_handler(struct intr_frame *);
 
@@ -19,6 +26,7 @@ static void syscall_handler(struct intr_frame *);
 #define ARG(type, name, f, n) type name = ({ \
 void *p = ((uint32_t *)((f)->esp) + (n)); \
 verify_user_pointer(p); \
+verify_user_pointer((uint8_t *)p + sizeof(type) - 1); \
 *(type *)p; \
 })
 #define RET(value, f) ((f)->eax = (uint32_t)(value))
@@ -40,7 +48,16 @@ static struct file* get_file_pointer_for_fd(int fd) {
 }
 
 static bool is_user_pointer_good(void* p) {
-    return is_user_vaddr(p) && pagedir_get_page(thread_current()->pagedir, p) != NULL;
+    if (!is_user_vaddr(p)) return false;
+    if (pagedir_get_page(thread_current()->pagedir, p) != NULL) return true;
+#ifdef VM
+    // Pages that aren't loaded yet are fine too; touching them
+    // just faults them in, or grows the stack down to them.
+    return pagetable_info_for_address(&thread_current()->pagetable, p) != NULL ||
+           pagetable_is_stack_access(p, thread_current()->user_esp);
+#else
+    return false;
+#endif
 }
 
 static void verify_user_pointer(void* p) {
@@ -49,11 +66,97 @@ static void verify_user_pointer(void* p) {
     }
 }
 
+// Makes sure the page at P belongs to the process, and that the process
+// may write to it if WRITE is set. With virtual memory, also brings the
+// page in and pins it, so the kernel can touch it without faulting.
+static bool pin_user_page(const void* p, bool write) {
+    if (!is_user_vaddr(p)) return false;
+#ifdef VM
+    return pagetable_pin_page((void *)p, write);
+#else
+    uint32_t *pd = thread_current()->pagedir;
+    return pagedir_get_page(pd, p) != NULL &&
+           (!write || pagedir_is_writable(pd, p));
+#endif
+}
+
+static void unpin_user_page(const void* p UNUSED) {
+#ifdef VM
+    pagetable_unpin_page((void *)p);
+#endif
+}
+
+// Unpins every page of the SIZE bytes starting at P.
+static void unpin_user_buffer(const void* p, unsigned size) {
+    const uint8_t *start = p;
+    const uint8_t *page;
+    for (page = start; page < start + size; page = pg_round_down(page) + PGSIZE) {
+        unpin_user_page(page);
+    }
+}
+
+// Pins every page of the SIZE bytes starting at P, for writing if WRITE is
+// set. Returns false, with nothing pinned, if any of them isn't the
+// process's to use that way.
+static bool try_pin_user_buffer(const void* p, unsigned size, bool write) {
+    const uint8_t *start = p;
+    const uint8_t *page;
+    if (size == 0) return true;
+    if (!is_user_vaddr(start) || size > (size_t)((uint8_t *)PHYS_BASE - start)) {
+        return false;
+    }
+    for (page = start; page < start + size; page = pg_round_down(page) + PGSIZE) {
+        if (!pin_user_page(page, write)) {
+            unpin_user_buffer(start, page - start);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pins a user buffer like try_pin_user_buffer(), killing the process if it
+// can't. This has to happen before the kernel takes any lock to work on
+// the buffer: a page fault with file system locks held could need those
+// same locks to bring the page in. Every pinned buffer must be unpinned
+// afterward.
+static void pin_user_buffer(const void* p, unsigned size, bool write) {
+    if (!try_pin_user_buffer(p, size, write)) {
+        thread_exit();
+    }
+}
+
+// Pins every page of the null-terminated string S like pin_user_buffer(),
+// reading only as far as the terminator.
+static void pin_user_string(const char* s) {
+    const char *c = s;
+    for (;;) {
+        if (!pin_user_page(c, false)) {
+            unpin_user_buffer(s, c - s);
+            thread_exit();
+        }
+        const char *next_page = (const char *)pg_round_down(c) + PGSIZE;
+        for (; c < next_page; c++) {
+            if (*c == '\0') return;
+        }
+    }
+}
+
+// Unpins a string pinned by pin_user_string().
+static void unpin_user_string(const char* s) {
+    unpin_user_buffer(s, strlen(s) + 1);
+}
+
 void syscall_init(void) {
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
 void syscall_handler(struct intr_frame *f) {
+#ifdef VM
+    // Remember where the user stack is in case the kernel
+    // has to grow it while touching user memory
+    thread_current()->user_esp = f->esp;
+#endif
+
     // Run system call
     ARG(uint32_t, syscall_id, f, 0);
     handlers[syscall_id](f);
@@ -69,12 +172,11 @@ void sys_exit(struct intr_frame *f) {
     thread_exit();
 }
 
-void sys_exec(struct intr_frame *f) {
-    ARG(const char *, file, f, 1);
-    verify_user_pointer((void *)file);
-    
-    tid_t child_tid = process_execute(file);
-
+// Returns the pid of the new child `child_tid` once it has loaded, or -1
+// if it failed to. If `set_directory` is set, the child also gets our
+// current directory; forked children copy it themselves.
+static void return_loaded_child(tid_t child_tid, bool set_directory,
+                                struct intr_frame *f) {
     // If a thread could not be created, fail.
     if (child_tid == TID_ERROR) {
         RET(TID_ERROR, f);
@@ -91,7 +193,7 @@ void sys_exec(struct intr_frame *f) {
             // Found child! Wait for it to load...
             sema_down(&(thread->loaded));
             // Set its current directory to our current directory
-            if (thread_current()->directory != NULL) {
+            if (set_directory && thread_current()->directory != NULL) {
                 thread->directory = dir_reopen(thread_current()->directory);
             }
             if (thread->load_status == 0) RET(child_tid, f);
@@ -104,6 +206,30 @@ void sys_exec(struct intr_frame *f) {
     ASSERT(false);
 }
 
+void sys_exec(struct intr_frame *f) {
+    ARG(const char *, file, f, 1);
+    pin_user_string(file);
+    tid_t child_tid = process_execute(file);
+    unpin_user_string(file);
+    
+    return_loaded_child(child_tid, true, f);
+}
+
+#ifdef VM
+
+void sys_fork(struct intr_frame *f) {
+    // The child shares our memory copy-on-write, and returns 0 from here
+    return_loaded_child(process_fork(f), false, f);
+}
+
+#else
+
+void sys_fork(struct intr_frame *f) {
+    RET(-1, f);
+}
+
+#endif
+
 void sys_wait(struct intr_frame *f) {
     ARG(int, pid, f, 1);
     RET(process_wait(pid), f);
@@ -112,31 +238,30 @@ void sys_wait(struct intr_frame *f) {
 void sys_create(struct intr_frame *f) {
     ARG(const char *, file, f, 1);
     ARG(unsigned, initial_size, f, 2);
-    verify_user_pointer((void *)file);
-
-    if (file == NULL) {
-        thread_exit();
-    } else {
-        RET(filesys_create(file, initial_size), f);
-    }
+    pin_user_string(file);
+    RET(filesys_create(file, initial_size), f);
+    unpin_user_string(file);
 }
 
 void sys_remove(struct intr_frame *f) {
     ARG(const char *, file, f, 1);
-    verify_user_pointer((void *)file);
+    pin_user_string(file);
     RET(filesys_remove(file), f);
+    unpin_user_string(file);
 }
 
 void sys_open(struct intr_frame *f) {
     ARG(const char *, file_name, f, 1);
-    verify_user_pointer((void *)file_name);
+    pin_user_string(file_name);
 
-    if (file_name == NULL || *file_name == (char)0) {
+    if (*file_name == (char)0) {
+        unpin_user_string(file_name);
         RET(-1, f);
         return;
     }
 
     struct file* x = filesys_open(file_name);
+    unpin_user_string(file_name);
 
     if (x == NULL) {
         RET(-1, f);
@@ -172,20 +297,21 @@ void sys_read(struct intr_frame *f ) {
     ARG(int, fd, f, 1);
     ARG(void *, buffer, f, 2);
     ARG(unsigned, size, f, 3);
-    verify_user_pointer((void *)buffer);
 
     if (fd == STDOUT_FILENO) {
         RET(-1, f);
         return;
     }
 
+    pin_user_buffer(buffer, size, true);
     if (fd == STDIN_FILENO) {
         input_init();
         char* cbuffer = (char*) buffer;
-        while (size > 0) {
+        unsigned remaining = size;
+        while (remaining > 0) {
             *cbuffer = input_getc();
             cbuffer++;
-            size--;
+            remaining--;
         }
         RET(size, f);
     } else {
@@ -196,19 +322,20 @@ void sys_read(struct intr_frame *f ) {
             RET(file_read(x, buffer, size), f);
         }
     }
+    unpin_user_buffer(buffer, size);
 }
 
 void sys_write(struct intr_frame *f) {
     ARG(int, fd, f, 1);
     ARG(const void *, buffer, f, 2);
     ARG(unsigned, size, f, 3);
-    verify_user_pointer((void *)buffer);
 
     if (fd == STDIN_FILENO) {
         RET(-1, f);
         return;
     }
 
+    pin_user_buffer(buffer, size, false);
     if (fd == STDOUT_FILENO) {
         putbuf(buffer, size);
         RET(size, f);
@@ -220,6 +347,7 @@ void sys_write(struct intr_frame *f) {
             RET(file_write(x, buffer, size), f);
         }
     }
+    unpin_user_buffer(buffer, size);
 }
 
 void sys_seek(struct intr_frame *f) {
@@ -261,25 +389,99 @@ void sys_close(struct intr_frame *f) {
     file_close(x);
 }
 
+#ifdef VM
+// Returns true if none of the LENGTH bytes starting at the page-aligned
+// ADDR is in use, so that a mapping can go there.
+static bool is_user_range_free(void *addr, off_t length) {
+    struct thread *t = thread_current();
+    uint8_t *page;
+
+    // The range must lie entirely in user memory, without wrapping,
+    // and leave room for the stack to grow.
+    uint8_t *last = (uint8_t *)addr + length - 1;
+    if (!is_user_vaddr(addr) || !is_user_vaddr(last) || last < (uint8_t *)addr ||
+        pagetable_is_stack_address(last)) {
+        return false;
+    }
+    
+    for (page = addr; page <= last; page += PGSIZE) {
+        if (pagedir_get_page(t->pagedir, page) != NULL ||
+            pagetable_info_for_address(&t->pagetable, page) != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void sys_mmap(struct intr_frame *f) {
-    ARG(int, fd UNUSED, f, 1);
-    ARG(void *, addr UNUSED, f, 2);
-    printf("sys_mmap!\n");
-    thread_exit();
+    ARG(int, fd, f, 1);
+    ARG(void *, addr, f, 2);
+    struct thread *t = thread_current();
+    struct file *file = get_file_pointer_for_fd(fd);
+
+    // The file must be open, nonempty and writable, since mappings are,
+    // and the mapping must start at a nonzero page boundary and not
+    // overlap anything.
+    if (file == NULL || addr == NULL || pg_ofs(addr) != 0 ||
+        file_get_inode(file)->deny_write_cnt > 0) {
+        RET(-1, f);
+        return;
+    }
+    off_t length = file_length(file);
+    if (length == 0 || !is_user_range_free(addr, length)) {
+        RET(-1, f);
+        return;
+    }
+
+    // Find the first free mapping ID
+    int mapid;
+    for (mapid = 0; mapid < MAX_MAPPED_FILES; mapid++) {
+        if (t->mapped_files[mapid] == NULL) break;
+    }
+    if (mapid == MAX_MAPPED_FILES) {
+        RET(-1, f);
+        return;
+    }
+
+    // Set up the pages. Nothing is read until they're touched.
+    lock_acquire(&t->pagetable_lock);
+    pagetable_install_file(&t->pagetable, file, true, addr);
+    t->mapped_files[mapid] = pagetable_info_for_address(&t->pagetable, addr);
+    lock_release(&t->pagetable_lock);
+    RET(mapid, f);
 }
 
 void sys_munmap(struct intr_frame *f) {
-    ARG(int, mapid UNUSED, f, 1);
-    printf("sys_munmap!\n");
-    thread_exit();
+    ARG(int, mapid, f, 1);
+    struct thread *t = thread_current();
+
+    if (mapid < 0 || mapid >= MAX_MAPPED_FILES || t->mapped_files[mapid] == NULL) {
+        return;
+    }
+
+    // Writes dirty pages back and removes them all from the page table.
+    lock_acquire(&t->pagetable_lock);
+    pagetable_uninstall_file(t->mapped_files[mapid]);
+    lock_release(&t->pagetable_lock);
+    t->mapped_files[mapid] = NULL;
+}
+#else
+// Without virtual memory there's nothing to map files into.
+void sys_mmap(struct intr_frame *f) {
+    RET(-1, f);
 }
 
+void sys_munmap(struct intr_frame *f UNUSED) {
+}
+#endif
+
 bool path_is_absolute(const char* s) { // The alternative is that it's relative
     return s[0] == '/';
 }
 
 void sys_chdir(struct intr_frame *f) {
     ARG(const char *, dir UNUSED, f, 1);
+    pin_user_string(dir);
 
     if (path_is_absolute(dir)) {
 
@@ -287,11 +489,13 @@ void sys_chdir(struct intr_frame *f) {
 
     }
 
+    unpin_user_string(dir);
     thread_exit();
 }
 
 void sys_mkdir(struct intr_frame *f) {
     ARG(const char *, dir UNUSED, f, 1);
+    pin_user_string(dir);
 
     if (path_is_absolute(dir)) {
         /* Split path by slashes */
@@ -309,6 +513,7 @@ void sys_mkdir(struct intr_frame *f) {
     } else {
         
     }
+    unpin_user_string(dir);
     thread_exit();
 }
 
@@ -330,3 +535,234 @@ void sys_inumber(struct intr_frame *f) {
     printf("sys_inumber!\n");
     thread_exit();
 }
+
+// Whether SIZE bytes starting at file position POSITION are all at
+// offsets an off_t can hold.
+static bool is_file_range_valid(unsigned position, unsigned size) {
+    return position <= INT32_MAX && size <= INT32_MAX - position;
+}
+
+void sys_pread(struct intr_frame *f) {
+    ARG(int, fd, f, 1);
+    ARG(void *, buffer, f, 2);
+    ARG(unsigned, size, f, 3);
+    ARG(unsigned, position, f, 4);
+
+    // Only files have positions, so the console is rejected.
+    struct file *x = get_file_pointer_for_fd(fd);
+    if (x == NULL || !is_file_range_valid(position, size)) {
+        RET(-1, f);
+    } else {
+        pin_user_buffer(buffer, size, true);
+        RET(file_read_at(x, buffer, size, position), f);
+        unpin_user_buffer(buffer, size);
+    }
+}
+
+void sys_pwrite(struct intr_frame *f) {
+    ARG(int, fd, f, 1);
+    ARG(const void *, buffer, f, 2);
+    ARG(unsigned, size, f, 3);
+    ARG(unsigned, position, f, 4);
+
+    // Only files have positions, so the console is rejected.
+    struct file *x = get_file_pointer_for_fd(fd);
+    if (x == NULL || !is_file_range_valid(position, size)) {
+        RET(-1, f);
+    } else {
+        pin_user_buffer(buffer, size, false);
+        RET(file_write_at(x, buffer, size, position), f);
+        unpin_user_buffer(buffer, size);
+    }
+}
+
+// Unpins the iovec array passed to readv or writev, and the first CNT
+// buffers it describes.
+static void unpin_user_iovec(const struct iovec *iov, int iovcnt, int cnt) {
+    int i;
+    for (i = 0; i < cnt; i++) {
+        unpin_user_buffer(iov[i].iov_base, iov[i].iov_len);
+    }
+    unpin_user_buffer(iov, iovcnt * sizeof *iov);
+}
+
+// Pins the iovec array passed to readv or writev, and every buffer it
+// describes, for writing if WRITE is set. Returns false if IOVCNT is out
+// of range, or if the buffers add up to more bytes than the call can
+// report having transferred.
+static bool pin_user_iovec(const struct iovec *iov, int iovcnt, bool write) {
+    size_t total = 0;
+    int i;
+    if (iovcnt < 0 || iovcnt > IOV_MAX) return false;
+    pin_user_buffer(iov, iovcnt * sizeof *iov, false);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > INT32_MAX - total) {
+            unpin_user_iovec(iov, iovcnt, 0);
+            return false;
+        }
+        total += iov[i].iov_len;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (!try_pin_user_buffer(iov[i].iov_base, iov[i].iov_len, write)) {
+            unpin_user_iovec(iov, iovcnt, i);
+            thread_exit();
+        }
+    }
+    return true;
+}
+
+void sys_readv(struct intr_frame *f) {
+    ARG(int, fd, f, 1);
+    ARG(const struct iovec *, iov, f, 2);
+    ARG(int, iovcnt, f, 3);
+
+    struct file *x = get_file_pointer_for_fd(fd);
+    if ((x == NULL && fd != STDIN_FILENO) ||
+        !pin_user_iovec(iov, iovcnt, true)) {
+        RET(-1, f);
+        return;
+    }
+
+    int total = 0;
+    int i;
+    if (fd == STDIN_FILENO) {
+        input_init();
+        for (i = 0; i < iovcnt; i++) {
+            char *cbuffer = iov[i].iov_base;
+            size_t j;
+            for (j = 0; j < iov[i].iov_len; j++) {
+                cbuffer[j] = input_getc();
+            }
+            total += iov[i].iov_len;
+        }
+    } else {
+        // Fill the buffers in order, stopping early at end of file.
+        for (i = 0; i < iovcnt; i++) {
+            off_t bytes_read = file_read(x, iov[i].iov_base, iov[i].iov_len);
+            total += bytes_read;
+            if (bytes_read < (off_t)iov[i].iov_len) break;
+        }
+    }
+    unpin_user_iovec(iov, iovcnt, iovcnt);
+    RET(total, f);
+}
+
+void sys_writev(struct intr_frame *f) {
+    ARG(int, fd, f, 1);
+    ARG(const struct iovec *, iov, f, 2);
+    ARG(int, iovcnt, f, 3);
+
+    struct file *x = get_file_pointer_for_fd(fd);
+    if ((x == NULL && fd != STDOUT_FILENO) ||
+        !pin_user_iovec(iov, iovcnt, false)) {
+        RET(-1, f);
+        return;
+    }
+
+    int total = 0;
+    int i;
+    if (fd == STDOUT_FILENO) {
+        for (i = 0; i < iovcnt; i++) {
+            putbuf(iov[i].iov_base, iov[i].iov_len);
+            total += iov[i].iov_len;
+        }
+    } else {
+        // Drain the buffers in order, stopping early on a short write.
+        for (i = 0; i < iovcnt; i++) {
+            off_t bytes_written = file_write(x, iov[i].iov_base, iov[i].iov_len);
+            total += bytes_written;
+            if (bytes_written < (off_t)iov[i].iov_len) break;
+        }
+    }
+    unpin_user_iovec(iov, iovcnt, iovcnt);
+    RET(total, f);
+}
+
+void sys_copy_file_range(struct intr_frame *f) {
+    ARG(int, fd_in, f, 1);
+    ARG(int, fd_out, f, 2);
+    ARG(unsigned, size, f, 3);
+
+    // The data never leaves the kernel, so only files are supported.
+    struct file *in = get_file_pointer_for_fd(fd_in);
+    struct file *out = get_file_pointer_for_fd(fd_out);
+    if (in == NULL || out == NULL) {
+        RET(-1, f);
+    } else {
+        RET(file_copy(out, in, size), f);
+    }
+}
+
+void sys_fsync(struct intr_frame *f) {
+    ARG(int, fd, f, 1);
+
+    struct file *x = get_file_pointer_for_fd(fd);
+    if (x == NULL) {
+        RET(false, f);
+    } else {
+        // The free map records which sectors the file owns, so it has
+        // to reach disk too.
+        file_sync(x);
+        free_map_sync();
+        RET(true, f);
+    }
+}
+
+void sys_sync(struct intr_frame *f UNUSED) {
+    buffer_flush();
+}
+
+void sys_statfs(struct intr_frame *f) {
+    ARG(struct statfs *, buf, f, 1);
+
+    // Fill in a kernel copy under the free map's lock, and copy it out
+    // once the lock is released.
+    struct statfs stats;
+    free_map_stat(&stats);
+    pin_user_buffer(buf, sizeof *buf, true);
+    memcpy(buf, &stats, sizeof *buf);
+    unpin_user_buffer(buf, sizeof *buf);
+    RET(true, f);
+}
+
+void sys_blockstat(struct intr_frame *f) {
+    ARG(const char *, device, f, 1);
+    ARG(struct blockstat *, buf, f, 2);
+    pin_user_string(device);
+    struct block *block = block_get_by_name(device);
+    unpin_user_string(device);
+
+    if (block == NULL) {
+        RET(false, f);
+        return;
+    }
+
+    // Take the snapshot with interrupts off into kernel memory, and only
+    // then copy it out, which may have to wait for the page.
+    struct blockstat stats;
+    block_get_stats(block, &stats);
+    pin_user_buffer(buf, sizeof *buf, true);
+    memcpy(buf, &stats, sizeof *buf);
+    unpin_user_buffer(buf, sizeof *buf);
+    RET(true, f);
+}
+
+// Copies the name of the INDEXth block device, in probe order, into NAME,
+// so that user programs can find the devices to pass to blockstat.
+// Returns false if there are no more devices.
+void sys_blockname(struct intr_frame *f) {
+    ARG(unsigned, index, f, 1);
+    ARG(char *, name, f, 2);
+
+    struct block *block = block_first();
+    while (block != NULL && index-- > 0) block = block_next(block);
+    if (block == NULL) {
+        RET(false, f);
+        return;
+    }
+
+    pin_user_buffer(name, BLOCKSTAT_NAME_MAX + 1, true);
+    strlcpy(name, block_name(block), BLOCKSTAT_NAME_MAX + 1);
+    unpin_user_buffer(name, BLOCKSTAT_NAME_MAX + 1);
+    RET(true, f);
+}
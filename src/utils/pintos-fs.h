@@ -0,0 +1,89 @@
+/*! \file pintos-fs.h
+ *
+ * The on-disk format of the Pintos file system, for host tools that read or
+ * write file system images without booting Pintos.  Mirrors the layouts in
+ * filesys/inode.h, filesys/inode.c, filesys/directory.c, filesys/filesys.h
+ * and lib/kernel/bitmap.c, which must be kept in step with this file.
+ */
+
+#ifndef PINTOS_FS_H
+#define PINTOS_FS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! Size of a sector in bytes. */
+#define FS_SECTOR_SIZE 512
+
+/*! Sectors of system file inodes. @{ */
+#define FS_FREE_MAP_SECTOR 0    /*!< Free map file inode sector. */
+#define FS_ROOT_DIR_SECTOR 1    /*!< Root directory file inode sector. */
+/*! @} */
+
+/*! Identifies an inode. */
+#define FS_INODE_MAGIC 0x494e4f44
+
+/*! Longest file name. */
+#define FS_NAME_MAX 14
+
+/*! One entry of an inode's or indirect sector's sector array. */
+struct fs_sector_entry {
+    bool loaded : 1;                    /*!< Is SECTOR valid? */
+    uint32_t sector;                    /*!< Sector number. */
+};
+
+/*! Entries in an indirect sector. */
+#define FS_ENTRIES_PER_SECTOR \
+    (FS_SECTOR_SIZE / sizeof (struct fs_sector_entry))
+
+/*! Root entries of an inode: FS_DIRECT_CNT entries that point straight at
+    data, then one indirect, one doubly indirect and one triply indirect
+    entry.  The kernel only handles files reachable without the triply
+    indirect entry. @{ */
+#define FS_DIRECT_CNT 12
+#define FS_INDIRECT_ENTRY FS_DIRECT_CNT
+#define FS_DOUBLE_ENTRY (FS_DIRECT_CNT + 1)
+#define FS_TRIPLE_ENTRY (FS_DIRECT_CNT + 2)
+#define FS_ROOT_ENTRY_CNT (FS_DIRECT_CNT + 3)
+/*! @} */
+
+/*! Most data sectors in a file the kernel can address. */
+#define FS_MAX_FILE_SECTORS \
+    (FS_DIRECT_CNT + FS_ENTRIES_PER_SECTOR \
+     + FS_ENTRIES_PER_SECTOR * FS_ENTRIES_PER_SECTOR)
+
+/*! On-disk inode.  Exactly FS_SECTOR_SIZE bytes long. */
+struct fs_inode {
+    struct fs_sector_entry sectors[FS_ROOT_ENTRY_CNT]; /*!< Sector tree. */
+    int32_t length;                     /*!< File size in bytes. */
+    uint32_t magic;                     /*!< FS_INODE_MAGIC. */
+    bool is_directory;                  /*!< Directory or file? */
+    uint8_t unused[FS_SECTOR_SIZE - FS_ROOT_ENTRY_CNT
+                   * sizeof (struct fs_sector_entry) - 9];
+};
+
+/*! An indirect sector. */
+struct fs_indirect {
+    struct fs_sector_entry sectors[FS_ENTRIES_PER_SECTOR];
+};
+
+/*! A directory entry. */
+struct fs_dir_entry {
+    uint32_t inode_sector;              /*!< Sector number of header. */
+    char name[FS_NAME_MAX + 1];         /*!< Null terminated file name. */
+    bool in_use;                        /*!< In use or free? */
+};
+
+/*! Bytes in the free map file of a file system of SECTOR_CNT sectors.  The
+    kernel's bitmap is an array of 32-bit words, bit I of the map being bit
+    I % 32 of word I / 32. */
+static inline uint32_t fs_free_map_bytes(uint32_t sector_cnt) {
+    return (sector_cnt + 31) / 32 * 4;
+}
+
+_Static_assert (sizeof (struct fs_sector_entry) == 8, "bad sector entry");
+_Static_assert (sizeof (struct fs_inode) == FS_SECTOR_SIZE, "bad inode");
+_Static_assert (sizeof (struct fs_indirect) == FS_SECTOR_SIZE, "bad indirect");
+_Static_assert (sizeof (struct fs_dir_entry) == 20, "bad dir entry");
+
+#endif /* pintos-fs.h */
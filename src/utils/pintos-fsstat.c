@@ -0,0 +1,473 @@
+/*! \file pintos-fsstat.c
+ *
+ * Reports how a Pintos file system image is laid out, without booting
+ * Pintos: extents and fragmentation per file, directory sizes, free space
+ * runs, indirect sectors placed far from the data they map, and sectors
+ * that the free map and the inodes disagree about.  Meant for comparing
+ * allocator changes offline after a workload has run.
+ *
+ *     pintos-fsstat build/filesys.dsk
+ *
+ * The image may be a raw file system, as written by pintos-mkfs, or a
+ * partitioned disk, in which case its file system partition is used.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pintos-fs.h"
+
+/*! Partition type of a Pintos file system. */
+#define PARTITION_TYPE_FILESYS 0x21
+
+/*! Default distance, in sectors, beyond which an indirect sector counts as
+    far from its data. */
+#define DEFAULT_FAR 128
+
+/*! Buckets of the free run histogram: runs of 1, 2-3, 4-7, ... sectors. */
+#define RUN_BUCKETS 24
+
+/*! Most directory levels followed. */
+#define MAX_DEPTH 16
+
+/*! Data and indirect sectors of one file. */
+struct layout {
+    uint32_t *data;                     /*!< Data sectors, in file order. */
+    uint32_t data_cnt;                  /*!< Number of DATA. */
+    uint32_t meta_cnt;                  /*!< Indirect sectors. */
+    uint32_t far_cnt;                   /*!< Indirect sectors far from the
+                                             first data sector they map. */
+};
+
+static uint8_t *image;                  /*!< File system contents. */
+static uint32_t sector_cnt;             /*!< File system size in sectors. */
+static uint8_t *ref_cnt;                /*!< References to each sector,
+                                             saturating at 255. */
+static uint32_t far_distance = DEFAULT_FAR;
+
+/*! Totals over all files. @{ */
+static unsigned long file_cnt, dir_cnt, fragmented_cnt;
+static unsigned long long total_data, total_extents, total_meta, total_far;
+static unsigned long bad_cnt;
+/*! @} */
+
+static void fail(const char *msg, ...)
+     __attribute__ ((noreturn))
+     __attribute__ ((format (printf, 1, 2)));
+static void usage(int exit_code) __attribute__ ((noreturn));
+
+/*!
+ * Prints MSG, formatting as with printf(), plus an error message based on
+ * errno if it is nonzero, and exits.
+ */
+static void fail(const char *msg, ...) {
+    va_list args;
+
+    fprintf(stderr, "pintos-fsstat: ");
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+
+    if (errno != 0)
+        fprintf(stderr, ": %s", strerror(errno));
+    putc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+static void usage(int exit_code) {
+    printf("pintos-fsstat, a utility for analyzing Pintos file system images\n"
+           "Usage: pintos-fsstat [OPTIONS] IMAGE\n"
+           "where IMAGE is a raw file system or a partitioned Pintos disk.\n"
+           "Options:\n"
+           "  -f, --far=SECTORS  Count indirect sectors more than SECTORS\n"
+           "                     from their data as far (default: %d)\n"
+           "  -h, --help         Display this help message.\n",
+           DEFAULT_FAR);
+    exit(exit_code);
+}
+
+/*! Returns sector SECTOR of the file system, or a null pointer, after
+    complaining, if SECTOR is out of range. */
+static const uint8_t *sector_data(uint32_t sector) {
+    if (sector >= sector_cnt) {
+        printf("  ! reference to sector %"PRIu32" past end of file system\n",
+               sector);
+        bad_cnt++;
+        return NULL;
+    }
+    return image + (size_t) sector * FS_SECTOR_SIZE;
+}
+
+/*! Records a reference to SECTOR. */
+static void reference(uint32_t sector) {
+    if (sector < sector_cnt && ref_cnt[sector] < UINT8_MAX)
+        ref_cnt[sector]++;
+}
+
+/*! Adds data sector SECTOR to L. */
+static void add_data(struct layout *l, uint32_t sector) {
+    if (l->data_cnt % 1024 == 0) {
+        l->data = realloc(l->data, (l->data_cnt + 1024) * sizeof *l->data);
+        if (l->data == NULL)
+            fail("out of memory");
+    }
+    l->data[l->data_cnt++] = sector;
+    reference(sector);
+}
+
+/*!
+ * Adds to L the sectors under indirect sector SECTOR, which maps data
+ * through LEVEL more levels of indirect sectors.  Returns the first data
+ * sector found, or UINT32_MAX if there is none.
+ */
+static uint32_t walk_indirect(struct layout *l, uint32_t sector, int level) {
+    const struct fs_indirect *ind = (const void *) sector_data(sector);
+    uint32_t first = UINT32_MAX;
+    size_t i;
+
+    reference(sector);
+    l->meta_cnt++;
+    if (ind == NULL)
+        return first;
+
+    for (i = 0; i < FS_ENTRIES_PER_SECTOR; i++) {
+        uint32_t found;
+        if (!ind->sectors[i].loaded)
+            continue;
+        if (level == 0) {
+            found = ind->sectors[i].sector;
+            add_data(l, found);
+        }
+        else
+            found = walk_indirect(l, ind->sectors[i].sector, level - 1);
+        if (first == UINT32_MAX)
+            first = found;
+    }
+
+    if (first != UINT32_MAX) {
+        uint32_t distance = first > sector ? first - sector : sector - first;
+        if (distance > far_distance)
+            l->far_cnt++;
+    }
+    return first;
+}
+
+/*! Collects the layout of the file whose inode is INODE into L. */
+static void walk_inode(const struct fs_inode *inode, struct layout *l) {
+    size_t i;
+
+    memset(l, 0, sizeof *l);
+    for (i = 0; i < FS_ROOT_ENTRY_CNT; i++) {
+        uint32_t sector = inode->sectors[i].sector;
+        if (!inode->sectors[i].loaded)
+            continue;
+        if (i < FS_DIRECT_CNT)
+            add_data(l, sector);
+        else
+            walk_indirect(l, sector, i - FS_INDIRECT_ENTRY);
+    }
+}
+
+/*! Returns the number of extents, i.e. runs of consecutive sectors, in
+    L's data. */
+static uint32_t count_extents(const struct layout *l) {
+    uint32_t extents = l->data_cnt > 0;
+    uint32_t i;
+
+    for (i = 1; i < l->data_cnt; i++)
+        if (l->data[i] != l->data[i - 1] + 1)
+            extents++;
+    return extents;
+}
+
+/*! Copies up to SIZE bytes of the data of the file laid out as L into
+    BUF. */
+static void read_data(const struct layout *l, void *buf, size_t size) {
+    uint8_t *p = buf;
+    uint32_t i;
+
+    memset(buf, 0, size);
+    for (i = 0; i < l->data_cnt && size > 0; i++) {
+        const uint8_t *data = sector_data(l->data[i]);
+        size_t chunk = size < FS_SECTOR_SIZE ? size : FS_SECTOR_SIZE;
+        if (data != NULL)
+            memcpy(p, data, chunk);
+        p += chunk;
+        size -= chunk;
+    }
+}
+
+/*! Returns the inode in SECTOR, or a null pointer, after complaining, if
+    there is no valid inode there. */
+static const struct fs_inode *get_inode(uint32_t sector, const char *path) {
+    const struct fs_inode *inode = (const void *) sector_data(sector);
+
+    if (inode != NULL && inode->magic != FS_INODE_MAGIC) {
+        printf("  ! %s: sector %"PRIu32" holds no inode\n", path, sector);
+        bad_cnt++;
+        return NULL;
+    }
+    return inode;
+}
+
+/*! Prints the line for file PATH with inode INODE in sector SECTOR and
+    layout L, and adds it to the totals. */
+static void report_file(const char *path, uint32_t sector,
+                        const struct fs_inode *inode,
+                        const struct layout *l) {
+    uint32_t extents = count_extents(l);
+
+    printf("  %-28s %7"PRIu32" %10"PRId32" %7"PRIu32" %7"PRIu32
+           " %6.1f %5"PRIu32" %4"PRIu32"\n",
+           path, sector, inode->length, l->data_cnt, extents,
+           extents > 0 ? (double) l->data_cnt / extents : 0.0,
+           l->meta_cnt, l->far_cnt);
+
+    file_cnt++;
+    total_data += l->data_cnt;
+    total_extents += extents;
+    total_meta += l->meta_cnt;
+    total_far += l->far_cnt;
+    if (extents > 1)
+        fragmented_cnt++;
+}
+
+/*!
+ * Reports on directory PATH, whose inode is in SECTOR, and everything in
+ * it.  Directory lines are stored in DIRS, to be printed separately.
+ */
+static void walk_dir(uint32_t sector, const char *path, int depth,
+                     FILE *dirs) {
+    const struct fs_inode *inode = get_inode(sector, path);
+    struct fs_dir_entry *entries;
+    struct layout l;
+    size_t entry_cnt, used = 0, i;
+
+    if (inode == NULL)
+        return;
+    reference(sector);
+    walk_inode(inode, &l);
+    report_file(path, sector, inode, &l);
+    dir_cnt++;
+    file_cnt--;
+
+    entry_cnt = inode->length / sizeof *entries;
+    entries = calloc(entry_cnt + 1, sizeof *entries);
+    if (entries == NULL)
+        fail("out of memory");
+    read_data(&l, entries, entry_cnt * sizeof *entries);
+    free(l.data);
+
+    for (i = 0; i < entry_cnt; i++) {
+        struct fs_dir_entry *e = &entries[i];
+        const struct fs_inode *child;
+        char child_path[512];
+
+        if (!e->in_use)
+            continue;
+        used++;
+        e->name[FS_NAME_MAX] = '\0';
+        snprintf(child_path, sizeof child_path, "%s%s%s", path,
+                 path[strlen(path) - 1] == '/' ? "" : "/", e->name);
+
+        child = get_inode(e->inode_sector, child_path);
+        if (child == NULL)
+            continue;
+        if (e->inode_sector < sector_cnt && ref_cnt[e->inode_sector] > 0) {
+            printf("  ! %s: inode %"PRIu32" already seen\n", child_path,
+                   e->inode_sector);
+            bad_cnt++;
+            continue;
+        }
+        if (child->is_directory) {
+            if (depth < MAX_DEPTH)
+                walk_dir(e->inode_sector, child_path, depth + 1, dirs);
+            continue;
+        }
+
+        reference(e->inode_sector);
+        walk_inode(child, &l);
+        report_file(child_path, e->inode_sector, child, &l);
+        free(l.data);
+    }
+
+    fprintf(dirs, "  %-28s %7zu %7zu %10"PRId32"\n", path, used, entry_cnt,
+            inode->length);
+    free(entries);
+}
+
+/*! Prints the free space report and checks the free map against the
+    sectors the inodes reference. */
+static void report_free_space(void) {
+    const struct fs_inode *inode = get_inode(FS_FREE_MAP_SECTOR, "free map");
+    unsigned long runs[RUN_BUCKETS];
+    unsigned long free_cnt = 0, run_cnt = 0, leaked = 0, lost = 0, shared = 0;
+    uint32_t largest = 0, run = 0, sector;
+    uint8_t *map;
+    struct layout l;
+    int i;
+
+    if (inode == NULL)
+        return;
+    reference(FS_FREE_MAP_SECTOR);
+    walk_inode(inode, &l);
+    map = calloc(fs_free_map_bytes(sector_cnt), 1);
+    if (map == NULL)
+        fail("out of memory");
+    read_data(&l, map, fs_free_map_bytes(sector_cnt));
+    report_file("(free map)", FS_FREE_MAP_SECTOR, inode, &l);
+    free(l.data);
+
+    memset(runs, 0, sizeof runs);
+    for (sector = 0; sector <= sector_cnt; sector++) {
+        bool in_use = sector < sector_cnt
+                      && (map[sector / 8] & (1u << (sector % 8))) != 0;
+
+        if (sector < sector_cnt && !in_use) {
+            free_cnt++;
+            run++;
+        }
+        else if (run > 0) {
+            for (i = 0; i < RUN_BUCKETS - 1 && (2u << i) <= run; i++)
+                continue;
+            runs[i]++;
+            run_cnt++;
+            if (run > largest)
+                largest = run;
+            run = 0;
+        }
+
+        if (sector == sector_cnt)
+            break;
+        if (in_use && ref_cnt[sector] == 0)
+            leaked++;
+        else if (!in_use && ref_cnt[sector] > 0)
+            lost++;
+        if (ref_cnt[sector] > 1)
+            shared++;
+    }
+    free(map);
+
+    printf("\nFree space: %lu of %"PRIu32" sectors (%.1f%%) in %lu runs, "
+           "largest %"PRIu32"\n", free_cnt, sector_cnt,
+           100.0 * free_cnt / sector_cnt, run_cnt, largest);
+    for (i = 0; i < RUN_BUCKETS; i++)
+        if (runs[i] != 0)
+            printf("  %8lu-%-8lu %7lu runs\n", 1ul << i, (2ul << i) - 1,
+                   runs[i]);
+
+    printf("\nConsistency:\n"
+           "  %lu sectors marked in use but unreferenced\n"
+           "  %lu sectors referenced but marked free\n"
+           "  %lu sectors referenced more than once\n"
+           "  %lu other problems\n", leaked, lost, shared, bad_cnt);
+}
+
+/*! Sets IMAGE and SECTOR_CNT to the file system in the SIZE bytes of DISK,
+    either all of it or its file system partition. */
+static void find_file_system(uint8_t *disk, size_t size) {
+    image = disk;
+    sector_cnt = size / FS_SECTOR_SIZE;
+
+    if (size >= FS_SECTOR_SIZE && disk[510] == 0x55 && disk[511] == 0xaa) {
+        int i;
+
+        for (i = 0; i < 4; i++) {
+            const uint8_t *e = disk + 446 + 16 * i;
+            uint32_t start, cnt;
+
+            memcpy(&start, e + 8, sizeof start);
+            memcpy(&cnt, e + 12, sizeof cnt);
+            if (e[4] == PARTITION_TYPE_FILESYS) {
+                errno = 0;
+                if ((uint64_t) start + cnt > size / FS_SECTOR_SIZE)
+                    fail("file system partition runs past end of disk");
+                image = disk + (size_t) start * FS_SECTOR_SIZE;
+                sector_cnt = cnt;
+                return;
+            }
+        }
+        errno = 0;
+        fail("disk has no Pintos file system partition");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"far", required_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *name;
+    uint8_t *disk;
+    size_t size;
+    FILE *in, *dirs;
+    char line[256];
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "f:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            far_distance = atoi(optarg);
+            break;
+        case 'h':
+            usage(EXIT_SUCCESS);
+        default:
+            usage(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1)
+        usage(EXIT_FAILURE);
+    name = argv[optind];
+
+    /* Read the whole image. */
+    in = fopen(name, "rb");
+    if (in == NULL || fseek(in, 0, SEEK_END) != 0)
+        fail("%s", name);
+    size = ftell(in);
+    disk = malloc(size + 1);
+    if (disk == NULL)
+        fail("out of memory");
+    rewind(in);
+    if (fread(disk, 1, size, in) != size)
+        fail("%s: read failed", name);
+    fclose(in);
+
+    find_file_system(disk, size);
+    errno = 0;
+    if (sector_cnt < 2)
+        fail("%s: too small for a file system", name);
+    ref_cnt = calloc(sector_cnt, 1);
+    dirs = tmpfile();
+    if (ref_cnt == NULL || dirs == NULL)
+        fail("out of memory");
+
+    printf("%s: %"PRIu32" sectors\n\n", name, sector_cnt);
+    printf("  %-28s %7s %10s %7s %7s %6s %5s %4s\n", "File", "Inode",
+           "Bytes", "Sectors", "Extents", "Avg", "Indir", "Far");
+    walk_dir(FS_ROOT_DIR_SECTOR, "/", 0, dirs);
+    report_free_space();
+
+    printf("\nDirectories:\n  %-28s %7s %7s %10s\n", "Directory", "Used",
+           "Slots", "Bytes");
+    rewind(dirs);
+    while (fgets(line, sizeof line, dirs) != NULL)
+        fputs(line, stdout);
+    fclose(dirs);
+
+    printf("\nSummary: %lu files, %lu directories\n", file_cnt, dir_cnt);
+    printf("  %llu data sectors in %llu extents (%.2f per file, "
+           "%.1f sectors each)\n", total_data, total_extents,
+           file_cnt + dir_cnt > 0
+           ? (double) total_extents / (file_cnt + dir_cnt) : 0.0,
+           total_extents > 0 ? (double) total_data / total_extents : 0.0);
+    printf("  %lu of %lu files fragmented\n", fragmented_cnt,
+           file_cnt + dir_cnt);
+    printf("  %llu indirect sectors, %llu more than %"PRIu32
+           " sectors from their data\n", total_meta, total_far, far_distance);
+    return bad_cnt == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
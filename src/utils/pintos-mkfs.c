@@ -0,0 +1,308 @@
+/*! \file pintos-mkfs.c
+ *
+ * Builds a Pintos file system image from files on the host, so that a
+ * test run can boot straight into a populated file system instead of
+ * formatting one and extracting files into it from the scratch disk.
+ *
+ *     pintos-mkfs fs.img ../../examples/echo tests/vm/page-linear:linear
+ *     pintos --filesys=fs.img -- run echo
+ *
+ * The image holds the free map, the root directory, and each file laid out
+ * contiguously with its indirect sectors just ahead of the data they map.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "pintos-fs.h"
+
+/*! Default image size in MB. */
+#define DEFAULT_SIZE_MB 2
+
+/*! Entries the kernel gives a freshly formatted root directory. */
+#define ROOT_DIR_ENTRIES 16
+
+/*! A file to put into the image. */
+struct input {
+    const char *host_name;              /*!< File on the host. */
+    const char *name;                   /*!< Name in the image. */
+    uint8_t *data;                      /*!< Contents. */
+    size_t size;                        /*!< Size of DATA in bytes. */
+};
+
+static uint8_t *image;                  /*!< Image contents. */
+static uint32_t sector_cnt;             /*!< Image size in sectors. */
+static uint8_t *free_map;               /*!< In-use bit per sector. */
+static uint32_t next_sector;            /*!< Next sector to allocate. */
+
+static void fail(const char *msg, ...)
+     __attribute__ ((noreturn))
+     __attribute__ ((format (printf, 1, 2)));
+static void usage(int exit_code) __attribute__ ((noreturn));
+
+/*!
+ * Prints MSG, formatting as with printf(), plus an error message based on
+ * errno if it is nonzero, and exits.
+ */
+static void fail(const char *msg, ...) {
+    va_list args;
+
+    fprintf(stderr, "pintos-mkfs: ");
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+
+    if (errno != 0)
+        fprintf(stderr, ": %s", strerror(errno));
+    putc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+static void usage(int exit_code) {
+    printf("pintos-mkfs, a utility for building Pintos file system images\n"
+           "Usage: pintos-mkfs [OPTIONS] IMAGE [FILE[:NAME]]...\n"
+           "where IMAGE is the image file to create and each FILE is a host\n"
+           "file to copy into its root directory, as NAME if given.\n"
+           "Use the image with \"pintos --filesys=IMAGE\" and leave out -f.\n"
+           "Options:\n"
+           "  -s, --size=MB   Make the image MB megabytes (default: %d)\n"
+           "  -h, --help      Display this help message.\n",
+           DEFAULT_SIZE_MB);
+    exit(exit_code);
+}
+
+/*! Returns sector SECTOR of the image. */
+static uint8_t *sector_data(uint32_t sector) {
+    return image + (size_t) sector * FS_SECTOR_SIZE;
+}
+
+/*! Allocates the next free sector and returns its number. */
+static uint32_t allocate(void) {
+    uint32_t sector = next_sector++;
+
+    errno = 0;
+    if (sector >= sector_cnt)
+        fail("image full; use a larger --size");
+    free_map[sector / 8] |= 1u << (sector % 8);
+    return sector;
+}
+
+/*! Points ENTRY at a newly allocated sector and returns that sector. */
+static uint32_t allocate_entry(struct fs_sector_entry *entry) {
+    entry->loaded = true;
+    entry->sector = allocate();
+    return entry->sector;
+}
+
+/*!
+ * Writes an inode at sector INODE_SECTOR for a file LENGTH bytes long and
+ * allocates its data sectors, each indirect sector just before the first
+ * data sector it maps.  Stores the data sector numbers into SECTORS.
+ */
+static void lay_out(uint32_t inode_sector, uint32_t length,
+                    bool is_directory, uint32_t *sectors) {
+    struct fs_inode *inode = (struct fs_inode *) sector_data(inode_sector);
+    uint32_t data_cnt = (length + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    struct fs_indirect *indirect = NULL, *double_indirect = NULL;
+    uint32_t i;
+
+    errno = 0;
+    if (data_cnt > FS_MAX_FILE_SECTORS)
+        fail("file of %"PRIu32" bytes is too big for Pintos", length);
+
+    memset(inode, 0, sizeof *inode);
+    inode->length = length;
+    inode->magic = FS_INODE_MAGIC;
+    inode->is_directory = is_directory;
+
+    for (i = 0; i < data_cnt; i++) {
+        struct fs_sector_entry *entry;
+
+        if (i < FS_DIRECT_CNT)
+            entry = &inode->sectors[i];
+        else if (i < FS_DIRECT_CNT + FS_ENTRIES_PER_SECTOR) {
+            uint32_t index = i - FS_DIRECT_CNT;
+            if (index == 0)
+                indirect = (struct fs_indirect *) sector_data(
+                    allocate_entry(&inode->sectors[FS_INDIRECT_ENTRY]));
+            entry = &indirect->sectors[index];
+        }
+        else {
+            uint32_t index = i - FS_DIRECT_CNT - FS_ENTRIES_PER_SECTOR;
+            if (index == 0)
+                double_indirect = (struct fs_indirect *) sector_data(
+                    allocate_entry(&inode->sectors[FS_DOUBLE_ENTRY]));
+            if (index % FS_ENTRIES_PER_SECTOR == 0)
+                indirect = (struct fs_indirect *) sector_data(allocate_entry(
+                    &double_indirect->sectors[index / FS_ENTRIES_PER_SECTOR]));
+            entry = &indirect->sectors[index % FS_ENTRIES_PER_SECTOR];
+        }
+        sectors[i] = allocate_entry(entry);
+    }
+}
+
+/*! Copies SIZE bytes of DATA into the data SECTORS of a file. */
+static void fill(const uint32_t *sectors, const void *data, size_t size) {
+    const uint8_t *p = data;
+    size_t i;
+
+    for (i = 0; size > 0; i++) {
+        size_t chunk = size < FS_SECTOR_SIZE ? size : FS_SECTOR_SIZE;
+        memcpy(sector_data(sectors[i]), p, chunk);
+        p += chunk;
+        size -= chunk;
+    }
+}
+
+/*! Reads INPUT's host file into memory. */
+static void read_input(struct input *input) {
+    FILE *file = fopen(input->host_name, "rb");
+    struct stat st;
+
+    if (file == NULL || fstat(fileno(file), &st) < 0)
+        fail("%s", input->host_name);
+    errno = 0;
+    if (st.st_size > INT32_MAX)
+        fail("%s: too big for Pintos", input->host_name);
+    input->size = st.st_size;
+    input->data = malloc(input->size + 1);
+    if (input->data == NULL)
+        fail("out of memory");
+    if (fread(input->data, 1, input->size, file) != input->size)
+        fail("%s: read failed", input->host_name);
+    fclose(file);
+}
+
+/*!
+ * Parses ARG, of the form FILE[:NAME], into INPUT.  Without NAME, the file
+ * goes in under its host file name without any directories.
+ */
+static void parse_input(char *arg, struct input *input) {
+    char *colon = strrchr(arg, ':');
+    const char *slash;
+
+    if (colon != NULL) {
+        *colon = '\0';
+        input->name = colon + 1;
+    }
+    else {
+        slash = strrchr(arg, '/');
+        input->name = slash != NULL ? slash + 1 : arg;
+    }
+    input->host_name = arg;
+
+    errno = 0;
+    if (*input->name == '\0' || strlen(input->name) > FS_NAME_MAX)
+        fail("\"%s\": Pintos file names must have 1 to %d characters",
+             input->name, FS_NAME_MAX);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"size", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    double size_mb = DEFAULT_SIZE_MB;
+    const char *image_name;
+    struct input *inputs;
+    uint32_t **input_sectors;
+    uint32_t *free_map_sectors, *root_sectors;
+    struct fs_dir_entry *entries;
+    uint32_t free_map_bytes, entry_cnt;
+    int input_cnt, i, j, opt;
+    FILE *out;
+
+    while ((opt = getopt_long(argc, argv, "s:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            size_mb = atof(optarg);
+            if (size_mb <= 0)
+                usage(EXIT_FAILURE);
+            break;
+        case 'h':
+            usage(EXIT_SUCCESS);
+        default:
+            usage(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc)
+        usage(EXIT_FAILURE);
+    image_name = argv[optind++];
+
+    /* Read the input files. */
+    input_cnt = argc - optind;
+    inputs = calloc(input_cnt + 1, sizeof *inputs);
+    input_sectors = calloc(input_cnt + 1, sizeof *input_sectors);
+    if (inputs == NULL || input_sectors == NULL)
+        fail("out of memory");
+    for (i = 0; i < input_cnt; i++) {
+        parse_input(argv[optind + i], &inputs[i]);
+        for (j = 0; j < i; j++) {
+            errno = 0;
+            if (!strcmp(inputs[i].name, inputs[j].name))
+                fail("\"%s\" given twice", inputs[i].name);
+        }
+        read_input(&inputs[i]);
+    }
+
+    /* Set up an empty image. */
+    sector_cnt = size_mb * 1024 * 1024 / FS_SECTOR_SIZE;
+    errno = 0;
+    if (sector_cnt < 2)
+        fail("image too small");
+    image = calloc(sector_cnt, FS_SECTOR_SIZE);
+    free_map_bytes = fs_free_map_bytes(sector_cnt);
+    free_map = calloc(free_map_bytes, 1);
+    if (image == NULL || free_map == NULL)
+        fail("out of memory");
+    next_sector = FS_FREE_MAP_SECTOR;
+    allocate();
+    allocate();
+
+    /* Lay out the free map and the root directory, then the files. */
+    entry_cnt = input_cnt > ROOT_DIR_ENTRIES ? input_cnt : ROOT_DIR_ENTRIES;
+    free_map_sectors = calloc(FS_MAX_FILE_SECTORS, sizeof (uint32_t));
+    root_sectors = calloc(FS_MAX_FILE_SECTORS, sizeof (uint32_t));
+    entries = calloc(entry_cnt, sizeof *entries);
+    if (free_map_sectors == NULL || root_sectors == NULL || entries == NULL)
+        fail("out of memory");
+    lay_out(FS_FREE_MAP_SECTOR, free_map_bytes, false, free_map_sectors);
+    lay_out(FS_ROOT_DIR_SECTOR, entry_cnt * sizeof *entries, true,
+            root_sectors);
+
+    for (i = 0; i < input_cnt; i++) {
+        struct fs_dir_entry *e = &entries[i];
+
+        input_sectors[i] = calloc(FS_MAX_FILE_SECTORS, sizeof (uint32_t));
+        if (input_sectors[i] == NULL)
+            fail("out of memory");
+        e->inode_sector = allocate();
+        strncpy(e->name, inputs[i].name, sizeof e->name - 1);
+        e->in_use = true;
+        lay_out(e->inode_sector, inputs[i].size, false, input_sectors[i]);
+        fill(input_sectors[i], inputs[i].data, inputs[i].size);
+    }
+
+    /* Now that every sector is allocated, fill in the system files. */
+    fill(root_sectors, entries, entry_cnt * sizeof *entries);
+    fill(free_map_sectors, free_map, free_map_bytes);
+
+    /* Write the image. */
+    errno = 0;
+    out = fopen(image_name, "wbx");
+    if (out == NULL)
+        fail("%s", image_name);
+    if (fwrite(image, FS_SECTOR_SIZE, sector_cnt, out) != sector_cnt
+        || fclose(out) != 0)
+        fail("%s: write failed", image_name);
+
+    printf("%s: %d files, %"PRIu32" of %"PRIu32" sectors used\n",
+           image_name, input_cnt, next_sector, sector_cnt);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+#include "vm/cow.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+// When a process forks, the pages it has contents for, in memory or in
+// swap, aren't copied. Instead the parent's page and the child's both
+// point at a copy-on-write page that holds the contents, and both map it
+// read-only. The first write through either of them faults and gives that
+// process a copy of its own. Until then the contents are evicted to swap
+// like any other page, on behalf of every page sharing them.
+
+// Contents shared copy-on-write by several pages.
+struct cow_page {
+    void *kpage;                // The frame, or NULL if not in memory.
+    bool loading;               // Whether a frame is being read in.
+    int ref_cnt;                // The page_infos sharing it.
+    struct list mappings;       // ...of those, the ones that map it.
+
+    // Stands in for the contents in swap, which keeps track of slots by
+    // page. Only its swap fields are used.
+    struct page_info contents;
+};
+
+struct lock cow_lock;
+
+// Signaled, with `cow_lock` held, when a page is done loading.
+static struct condition page_loaded;
+
+// Copy-on-write statistics.
+static long long share_cnt;             // Pages shared by forks.
+static long long copy_cnt;              // Pages copied on a write.
+static long long reuse_cnt;             // Pages taken over on a write.
+
+void cow_init(void) {
+    lock_init(&cow_lock);
+    cond_init(&page_loaded);
+}
+
+// Must be called with `cow_lock` held. Drops one page's share of the
+// contents, freeing them once nobody shares them anymore.
+static void _cow_release(struct cow_page *cow) {
+    ASSERT(cow->ref_cnt > 0);
+    if (--cow->ref_cnt > 0) return;
+
+    ASSERT(list_empty(&cow->mappings));
+    ASSERT(!cow->loading);
+    if (cow->kpage != NULL) frametable_free_page(cow->kpage);
+    if (cow->contents.has_swap_slot) delete_swapped_page(&cow->contents);
+    free(cow);
+}
+
+// MARK: Sharing
+
+// Shares the contents of page `page`, which is mapped in `pagedir` if it's
+// loaded, with its copy `copy` in a new child process. A page that isn't
+// shared yet hands its frame or its swap slot over to a new copy-on-write
+// page, and is unmapped so that it's mapped back read-only when it's next
+// used. The caller must hold the pagetable lock of the page's process.
+void cow_share_page(struct page_info *page, uint32_t *pagedir,
+                    struct page_info *copy) {
+    ASSERT(page->restoration_method == SWAP_RESTORATION);
+    ASSERT(page->state != UNINITIALIZED_STATE);
+    ASSERT(!page->shared.text);
+
+    lock_acquire(&cow_lock);
+    struct cow_page *cow = page->shared.cow;
+    if (cow == NULL) {
+        cow = malloc(sizeof(struct cow_page));
+        if (cow == NULL) {
+            PANIC("Unable to allocate memory to store cow_page.");
+        }
+        memset(cow, 0, sizeof(*cow));
+        cow->ref_cnt = 1;
+        list_init(&cow->mappings);
+
+        if (page->state == LOADED_STATE) {
+            cow->kpage = pagedir_uninstall_page(pagedir,
+                                                page->virtual_address);
+            frametable_set_cow(cow->kpage, cow);
+            page->state = EVICTED_STATE;
+
+            // Without the dirty bit there's no telling whether a copy
+            // kept in swap is still good
+            if (page->has_swap_slot) delete_swapped_page(page);
+        } else {
+            move_swapped_page(page, &cow->contents, NULL);
+        }
+        page->shared.cow = cow;
+    }
+
+    cow->ref_cnt++;
+    copy->shared.cow = cow;
+    copy->state = EVICTED_STATE;
+    copy->has_swap_slot = false;
+    share_cnt++;
+    lock_release(&cow_lock);
+}
+
+// Maps the copy-on-write page `page` into the current process, read-only,
+// reading the contents in from swap first if need be. This should only
+// be called by `pagetable_load_page`.
+void cow_load_page(struct page_info *page) {
+    struct cow_page *cow = page->shared.cow;
+
+    ASSERT(cow != NULL);
+    ASSERT(page->state != LOADED_STATE);
+
+    lock_acquire(&cow_lock);
+    while (cow->kpage == NULL) {
+        if (cow->loading) {
+            // Somebody else sharing it is reading it in
+            cond_wait(&page_loaded, &cow_lock);
+            continue;
+        }
+
+        // Read the contents in without the lock, since getting a frame
+        // may have to evict. The slot can't go anywhere while we hold a
+        // share of it.
+        cow->loading = true;
+        lock_release(&cow_lock);
+
+        void *kpage = frametable_create_page(0);
+        copy_swapped_page_into_frame(&cow->contents, kpage);
+
+        lock_acquire(&cow_lock);
+        frametable_set_cow(kpage, cow);
+        cow->kpage = kpage;
+        cow->loading = false;
+        cond_broadcast(&page_loaded, &cow_lock);
+    }
+
+    pagetable_map_shared(page, cow->kpage, &cow->mappings);
+    lock_release(&cow_lock);
+}
+
+// Stops the copy-on-write page `page` of the current process from sharing
+// its contents, since it's about to be written. Returns a pinned frame of
+// the current process's that holds the contents: the shared frame itself
+// if nobody else shares it anymore, or else a copy. The page is left
+// unmapped, ready to be installed writable.
+void *cow_unshare_page(struct page_info *page) {
+    struct cow_page *cow = page->shared.cow;
+    void *kpage = NULL;
+
+    ASSERT(cow != NULL);
+
+    // Unless we can take the frame over, get one to copy into. That has
+    // to happen without the lock, since it may have to evict.
+    lock_acquire(&cow_lock);
+    while (kpage == NULL && !(cow->ref_cnt == 1 && cow->kpage != NULL)) {
+        lock_release(&cow_lock);
+        kpage = frametable_create_page(0);
+        lock_acquire(&cow_lock);
+    }
+
+    pagetable_unmap_shared(page);
+    if (cow->ref_cnt == 1 && cow->kpage != NULL) {
+        // We're the last page sharing it, so take it over
+        if (kpage != NULL) frametable_free_page(kpage);
+        kpage = cow->kpage;
+        cow->kpage = NULL;
+        frametable_set_cow(kpage, NULL);
+        reuse_cnt++;
+    } else {
+        if (cow->kpage != NULL) {
+            memcpy(kpage, cow->kpage, PGSIZE);
+        } else {
+            copy_swapped_page_into_frame(&cow->contents, kpage);
+        }
+        copy_cnt++;
+    }
+
+    page->shared.cow = NULL;
+    _cow_release(cow);
+    lock_release(&cow_lock);
+    return kpage;
+}
+
+// Unmaps the copy-on-write page `page` from the current process, if it's
+// mapped, and gives up its share of the contents.
+void cow_unload_page(struct page_info *page) {
+    struct cow_page *cow = page->shared.cow;
+
+    ASSERT(cow != NULL);
+
+    lock_acquire(&cow_lock);
+    pagetable_unmap_shared(page);
+    page->shared.cow = NULL;
+    _cow_release(cow);
+    lock_release(&cow_lock);
+}
+
+// MARK: Eviction
+
+// Must be called with `cow_lock` held. Whether the contents have been
+// used since the last time their accessed bits were reset. If `clear` is
+// set, resets all of them.
+bool cow_test_accessed(struct cow_page *cow, bool clear) {
+    ASSERT(lock_held_by_current_thread(&cow_lock));
+    ASSERT(cow->kpage != NULL);
+
+    return pagetable_shared_accessed(&cow->mappings, cow->kpage, clear);
+}
+
+// Must be called with `cow_lock` held. Unmaps the contents from every page
+// sharing them and writes them to swap, without freeing their frame.
+// Returns the kernel address of the frame.
+void *cow_evict_page(struct cow_page *cow) {
+    ASSERT(lock_held_by_current_thread(&cow_lock));
+    ASSERT(cow->kpage != NULL);
+
+    pagetable_unmap_all_shared(&cow->mappings);
+
+    // Nothing can write to the contents while they're shared, so a copy
+    // that is already in swap is still good
+    void *kpage = cow->kpage;
+    if (!keep_swapped_copy(&cow->contents, false)) {
+        struct page_info *contents = &cow->contents;
+        uint32_t *pagedir = NULL;
+        add_pages_to_swapfile(&contents, &pagedir, &kpage, 1);
+    }
+    cow->kpage = NULL;
+    return kpage;
+}
+
+// Prints copy-on-write statistics.
+void cow_print_stats(void) {
+    printf("Copy-on-write: %lld pages shared, %lld copied, %lld taken over\n",
+           share_cnt, copy_cnt, reuse_cnt);
+}
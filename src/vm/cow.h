@@ -0,0 +1,25 @@
+#ifndef VM_COW_H
+#define VM_COW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "vm/page.h"
+
+struct cow_page;
+
+// Guards every copy-on-write page and its mappings. Like the pagetable
+// locks, evictors only ever try to acquire it.
+extern struct lock cow_lock;
+
+void cow_init(void);
+void cow_share_page(struct page_info *page, uint32_t *pagedir,
+                    struct page_info *copy);
+void cow_load_page(struct page_info *page);
+void *cow_unshare_page(struct page_info *page);
+void cow_unload_page(struct page_info *page);
+bool cow_test_accessed(struct cow_page *cow, bool clear);
+void *cow_evict_page(struct cow_page *cow);
+void cow_print_stats(void);
+
+#endif /* vm/cow.h */
@@ -1,12 +1,17 @@
 #include "vm/frame.h"
 #include <debug.h>
-#include <list.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "vm/cow.h"
+#include "vm/swap.h"
+#include "vm/text.h"
 
 // `frametable` is a malloc'ed region of memory big enough to hold
 // as many frame_info structs as there are frames in physical memory.
@@ -16,21 +21,69 @@
 // in physical memory.
 struct frame_info *frametable;
 
-// frame_eviction_queue represents an ordering of the frames that is
-// unrelated to their ordering in physical memory. It will be used for
-// a second chance eviction algorithm.
-struct list frame_eviction_queue;
+// Victims are chosen by a two-handed clock that sweeps the part of
+// `frametable` covering the user pool, [clock_start, clock_end). The front
+// hand clears accessed bits, and the back hand, `handspread` frames behind
+// it, evicts the first frame that hasn't been used again since. Both hands
+// are just indices, so a sweep walks the array in order.
+static size_t clock_start;
+static size_t clock_end;
+static size_t front_hand;
+static size_t back_hand;
 
+// Eviction statistics.
+static long long allocation_cnt;        // Frames handed out.
+static long long free_hit_cnt;          // ...that palloc had free.
+static long long eviction_cnt;          // Pages evicted.
+static long long background_cnt;        // ...by the page-out daemon.
+static long long scan_cnt;              // Frames the back hand passed.
+static long long second_chance_cnt;     // ...that had been used again.
+static long long skip_cnt;              // ...that were free or pinned.
+
+// Guards the frametable and the clock hands. It is only held while
+// they're being looked at or updated, never across disk I/O, so that a
+// thread that finds a free frame never waits on somebody's eviction.
 struct lock frame_lock;
 
+// The page-out daemon evicts pages in the background whenever fewer than
+// `low_watermark` user frames are free, until `high_watermark` are free.
+// Page faults then normally find a free frame without evicting anything.
+static size_t low_watermark;
+static size_t high_watermark;
+
+// Signaled, with `frame_lock` held, when the free frames drop below
+// the low watermark.
+static struct condition pageout_needed;
+
+static void pageout_daemon(void *aux UNUSED);
+static void _frametable_claim_page(void *page);
+
 void frametable_init(void) {
 	// init_ram_pages is the number of 4KB pages aka frames in physical RAM
 	int frametable_size_in_bytes = init_ram_pages * sizeof(struct frame_info);
-    frametable = malloc(frametable_size_in_bytes);
+    frametable = calloc(1, frametable_size_in_bytes);
+    if (frametable == NULL) {
+        PANIC("Unable to allocate the frame table.");
+    }
 
-    list_init(&frame_eviction_queue);
+    // The clock only needs to cover the frames of the user pool
+    clock_start = vtop(palloc_user_pool_base()) / PGSIZE;
+    clock_end = clock_start + palloc_user_page_cnt();
+    size_t handspread = (clock_end - clock_start) / 4;
+    if (handspread == 0) handspread = 1;
+    back_hand = clock_start;
+    front_hand = clock_start + handspread % (clock_end - clock_start);
 
     lock_init(&frame_lock);
+    cond_init(&pageout_needed);
+
+    // Keep about 3% of user memory free, and evict twice that at a time
+    // so the daemon works in batches rather than a page per fault.
+    low_watermark = palloc_user_page_cnt() / 32;
+    if (low_watermark < 4) low_watermark = 4;
+    high_watermark = low_watermark * 2;
+
+    thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
 }
 
 // Takes a kernel virtual address and returns a frame_info struct
@@ -39,7 +92,7 @@ struct frame_info *frame_for_page(void *page) {
     // given page actually falls on a page boundary
     uintptr_t physical_address = vtop(page);
     ASSERT((int)physical_address % PGSIZE == 0);
-    
+
     // Compute the frametable index from the physical address
     // and return the appropriate frame.
     int index = physical_address / PGSIZE;
@@ -51,93 +104,348 @@ void *page_for_frame(struct frame_info *frame) {
     // Get the index and make sure its valid
     int frame_index = frame - frametable;
     ASSERT(frame_index >= 0 && frame_index < (int)init_ram_pages);
-    
+
     // Compute the physical address for a given index
     // and convert to a kernel virtual address
     uintptr_t physical_address = frame_index * PGSIZE;
     return ptov(physical_address);
 }
-static struct frame_info* choose_frame_for_eviction(void) {
 
-    ASSERT(!list_empty(&frame_eviction_queue));
+// The lock that has to be held to evict the page in the frame: the
+// pagetable lock of its owner, or the lock of the shared page in it.
+static struct lock *frame_owner_lock(struct frame_info *frame) {
+    if (frame->text != NULL) return &textcache_lock;
+    if (frame->cow != NULL) return &cow_lock;
+    return &frame->owner->pagetable_lock;
+}
+
+// Whether the lock is one that guards a kind of shared page, for every
+// process at once, rather than a single process's pages.
+static inline bool is_shared_lock(struct lock *lock) {
+    return lock == &textcache_lock || lock == &cow_lock;
+}
+
+// Takes the lock of the frame's owner so that its page can be evicted,
+// without ever blocking since we hold `frame_lock`. A thread that is
+// evicting to satisfy its own page fault already holds its own, and one
+// evicting several shared pages only takes their lock once.
+// Returns whether the owner's page can be evicted, and sets `acquired`
+// if the caller has to release the lock afterward.
+static bool lock_frame_owner(struct frame_info *frame, bool *acquired) {
+    struct lock *lock = frame_owner_lock(frame);
+
+    *acquired = false;
+    if (lock_held_by_current_thread(lock)) return true;
+    *acquired = lock_try_acquire(lock);
+    return *acquired;
+}
 
-    struct frame_info* front_frame;
-    do {
-        struct list_elem* front_list_elem = list_front(&frame_eviction_queue);
-        front_frame = list_entry(front_list_elem, struct frame_info, eviction_queue_list_elem);
-        void* kpage_for_front_frame = page_for_frame(front_frame);
-        void* upage_for_front_frame = front_frame->user_vaddr;
+// Moves a clock hand to the next frame of the user pool.
+static size_t advance_hand(size_t hand) {
+    return hand + 1 < clock_end ? hand + 1 : clock_start;
+}
 
-        list_pop_front(&frame_eviction_queue);
-        list_push_back(&frame_eviction_queue, &(front_frame->eviction_queue_list_elem));
+// Whether the frame holds a user page that is done loading. Free frames
+// and pinned ones are passed over with just this check.
+static inline bool is_evictable(const struct frame_info *frame) {
+    return frame->is_user_page && !frame->is_pinned && frame->pin_cnt == 0;
+}
 
-        bool has_been_accessed = pagedir_is_accessed(thread_current()->pagedir, kpage_for_front_frame) &&
-                                 pagedir_is_accessed(thread_current()->pagedir, upage_for_front_frame);
-        bool is_pinned = front_frame->is_pinned;
+// Whether the page in an evictable frame has been used, through either
+// the owner's mapping or the kernel's alias of the frame, since the front
+// hand last passed it. If `clear` is set, resets both accessed bits.
+static bool test_accessed(struct frame_info *frame, bool clear) {
+    if (frame->text != NULL || frame->cow != NULL) {
+        // The mappings of a shared page can only be looked at with its
+        // lock, so if somebody has it, count the page as used
+        struct lock *lock = frame_owner_lock(frame);
+        bool held = lock_held_by_current_thread(lock);
+        if (!held && !lock_try_acquire(lock)) return true;
+        bool accessed = frame->text != NULL
+                        ? textcache_test_accessed(frame->text, clear)
+                        : cow_test_accessed(frame->cow, clear);
+        if (!held) lock_release(lock);
+        return accessed;
+    }
+
+    uint32_t *pagedir = frame->owner->pagedir;
+    void *kpage = page_for_frame(frame);
+    void *upage = frame->page->virtual_address;
+    bool accessed = pagedir_is_accessed(pagedir, kpage) ||
+                    pagedir_is_accessed(pagedir, upage);
+
+    if (accessed && clear) {
+        pagedir_set_accessed(pagedir, kpage, false);
+        pagedir_set_accessed(pagedir, upage, false);
+    }
+    return accessed;
+}
 
-        if (has_been_accessed || is_pinned) {
-            // This isn't our guy
-            pagedir_set_accessed(thread_current()->pagedir, kpage_for_front_frame, false);
-            pagedir_set_accessed(thread_current()->pagedir, upage_for_front_frame, false);
+// Must be called with `frame_lock` held. Returns a frame whose owner's
+// pagetable lock is held as described by `lock_frame_owner`, or NULL if
+// two full sweeps turn up nothing that can be evicted.
+static struct frame_info* choose_frame_for_eviction(bool *acquired) {
+    size_t remaining = (clock_end - clock_start) * 2;
+
+    while (remaining-- > 0) {
+        struct frame_info *front = &frametable[front_hand];
+        struct frame_info *back = &frametable[back_hand];
+        front_hand = advance_hand(front_hand);
+        back_hand = advance_hand(back_hand);
+        scan_cnt++;
+
+        // The front hand starts every page's second chance
+        if (is_evictable(front)) test_accessed(front, true);
+
+        // The back hand takes any page that didn't use it
+        if (!is_evictable(back)) {
+            skip_cnt++;
+        } else if (test_accessed(back, false)) {
+            second_chance_cnt++;
+        } else if (lock_frame_owner(back, acquired)) {
+            ASSERT(back->page != NULL || back->text != NULL ||
+                   back->cow != NULL);
+            return back;
+        }
+    }
+    return NULL;
+}
+
+// Chooses up to `max` frames, at most SWAP_CLUSTER_PAGES, evicts the pages
+// in them together and stores the frames, still pinned, in `pages`.
+// Returns how many were evicted, which is 0 if nothing can be evicted
+// right now. The disk I/O happens without `frame_lock`.
+static size_t evict_frames(void **pages, size_t max) {
+    struct frame_info *victims[SWAP_CLUSTER_PAGES];
+    bool acquired[SWAP_CLUSTER_PAGES];
+    struct lock *locks[SWAP_CLUSTER_PAGES];
+    struct page_info *evict_me[SWAP_CLUSTER_PAGES];
+    uint32_t *pagedirs[SWAP_CLUSTER_PAGES];
+    void *kpages[SWAP_CLUSTER_PAGES];
+    size_t owned[SWAP_CLUSTER_PAGES];
+    size_t cnt = 0;
+    size_t owned_cnt = 0;
+    size_t i;
+
+    ASSERT(max <= SWAP_CLUSTER_PAGES);
+
+    lock_acquire(&frame_lock);
+    while (cnt < max) {
+        struct frame_info *victim = choose_frame_for_eviction(&acquired[cnt]);
+        if (victim == NULL) break;
+        victim->is_pinned = true;
+        locks[cnt] = frame_owner_lock(victim);
+        victims[cnt++] = victim;
+    }
+    eviction_cnt += cnt;
+    lock_release(&frame_lock);
+
+    // Evict the shared pages first, and let go of their locks before
+    // writing anything to a file, since that may have to invalidate
+    // pages in the text cache.
+    for (i = 0; i < cnt; i++) {
+        if (victims[i]->text != NULL) {
+            pages[i] = textcache_evict_page(victims[i]->text);
+            victims[i]->text = NULL;
+        } else if (victims[i]->cow != NULL) {
+            pages[i] = cow_evict_page(victims[i]->cow);
+            victims[i]->cow = NULL;
         } else {
-            ASSERT(front_frame->is_user_page);
-            // printf("Evicting frame %d with user_vaddr %p\n", front_frame - frametable, (front_frame)->user_vaddr);
-            return front_frame;
+            owned[owned_cnt++] = i;
         }
-    } while (true);
+    }
+    for (i = 0; i < cnt; i++) {
+        if (acquired[i] && is_shared_lock(locks[i])) {
+            lock_release(locks[i]);
+        }
+    }
+
+    // Evict the other pages from their owners' address spaces. The
+    // reverse mapping takes us straight to them, whoever's address
+    // spaces they are.
+    for (i = 0; i < owned_cnt; i++) {
+        struct frame_info *victim = victims[owned[i]];
+        evict_me[i] = victim->page;
+        pagedirs[i] = victim->owner->pagedir;
+        ASSERT(evict_me[i]->state == LOADED_STATE);
+        ASSERT(is_user_vaddr(evict_me[i]->virtual_address));
+    }
+    if (owned_cnt > 0) {
+        pagetable_evict_pages(evict_me, pagedirs, kpages, owned_cnt);
+    }
+    for (i = 0; i < owned_cnt; i++) {
+        struct frame_info *victim = victims[owned[i]];
+        pages[owned[i]] = kpages[i];
+        victim->page = NULL;
+        if (acquired[owned[i]]) lock_release(locks[owned[i]]);
+    }
+
+    for (i = 0; i < cnt; i++) {
+        ASSERT(pages[i] == page_for_frame(victims[i]));
+    }
+    return cnt;
+}
+
+// Wakes the page-out daemon if free frames are running low.
+// Must be called with `frame_lock` held.
+static void check_watermark(void) {
+    if (palloc_user_free_cnt() < low_watermark) {
+        cond_signal(&pageout_needed, &frame_lock);
+    }
+}
+
+// Keeps between `low_watermark` and `high_watermark` frames free by
+// evicting pages ahead of the faults that will need their frames.
+static void pageout_daemon(void *aux UNUSED) {
+    for (;;) {
+        // Sleep until frames run low
+        lock_acquire(&frame_lock);
+        while (palloc_user_free_cnt() >= low_watermark) {
+            cond_wait(&pageout_needed, &frame_lock);
+        }
+        lock_release(&frame_lock);
+
+        // Free frames until we're back up to the high watermark, a
+        // cluster at a time
+        size_t free_cnt;
+        while ((free_cnt = palloc_user_free_cnt()) < high_watermark) {
+            void *pages[SWAP_CLUSTER_PAGES];
+            size_t want = high_watermark - free_cnt;
+            size_t cnt = evict_frames(pages, want < SWAP_CLUSTER_PAGES ?
+                                             want : SWAP_CLUSTER_PAGES);
+            if (cnt == 0) {
+                // Everything is pinned or busy, so give it a moment
+                timer_sleep(1);
+                break;
+            }
+            background_cnt += cnt;
+            while (cnt > 0) frametable_free_page(pages[--cnt]);
+        }
+    }
 }
 
 // Creates a new pinned page with the given flags, returning a pointer to this page.
 void *frametable_create_page(enum palloc_flags flags) {  // PAL_USER is implied
-    lock_acquire(&frame_lock);
-
     // Try to get a new page from palloc
     // page is a kernel virtual address
     void *page = palloc_get_page(flags | PAL_USER);
+    if (page != NULL) free_hit_cnt++;
+
+    while (page == NULL) {
+        // We were out of space, and the page-out daemon couldn't
+        // keep up, so we'll have to evict a page ourselves.
+        if (evict_frames(&page, 1) == 0) {
+            thread_yield();
+            page = palloc_get_page(flags | PAL_USER);
+        } else if (flags & PAL_ZERO) {
+            memset(page, 0, PGSIZE);
+        }
+    }
+
+    _frametable_claim_page(page);
+    return page;
+}
 
-    if (page == NULL) {
-        // We were out of space!
+// Creates a new pinned page like `frametable_create_page`, but only from
+// the free frames above the low watermark, never evicting anything.
+// Returns NULL if there's no such frame.
+void *frametable_create_page_if_free(void) {
+    if (palloc_user_free_cnt() <= low_watermark) return NULL;
+    void *page = palloc_get_page(PAL_USER);
+    if (page == NULL) return NULL;
+    free_hit_cnt++;
 
-        // Choose a frame to evict
-        struct frame_info* evict_me_f = choose_frame_for_eviction();
-        ASSERT(evict_me_f->user_vaddr);
-        ASSERT(is_user_vaddr(evict_me_f->user_vaddr));
-        struct page_info* evict_me_pi = pagetable_info_for_address(&(thread_current()->pagetable), evict_me_f->user_vaddr);
-        ASSERT(evict_me_pi->virtual_address == evict_me_f->user_vaddr);
-        ASSERT(evict_me_pi != NULL);
-        pagetable_evict_page(evict_me_pi);
+    _frametable_claim_page(page);
+    return page;
+}
 
-        // We've freed up some space!
-        page = page_for_frame(evict_me_f);
-    }
- 
+// Sets up the frame_info entry of a page just taken from palloc.
+static void _frametable_claim_page(void *page) {
     // Alright, we've finally gotten a valid page.
     // Let's do any initialization needed for the frame_info entry.
+    lock_acquire(&frame_lock);
     struct frame_info *frame = frame_for_page(page);
     frame->is_user_page = true;
     frame->is_pinned = true;
-    frame->user_vaddr = page;
+    frame->pin_cnt = 0;
+    frame->owner = thread_current();
+    frame->page = NULL;
+    frame->text = NULL;
+    frame->cow = NULL;
+    allocation_cnt++;
 
-    // Add to the end of the eviction queue
-    list_push_back(&frame_eviction_queue, &(frame->eviction_queue_list_elem));
-    
     // Make sure that our page_for_frame and frame_for_page functions work properly.
     // No particular reason to be here, but where else :)?
     ASSERT(page == page_for_frame(frame_for_page(page)));
-    
+
+    check_watermark();
     lock_release(&frame_lock);
-    return page;
 }
 
 // Frees the given user page
 void frametable_free_page(void *page) {
     // Cleanup table entry
+    lock_acquire(&frame_lock);
     struct frame_info *frame = frame_for_page(page);
     frame->is_user_page = false;
-    frame->user_vaddr = NULL;
+    frame->owner = NULL;
+    frame->is_pinned = false;
+    frame->pin_cnt = 0;
+    frame->page = NULL;
+    frame->text = NULL;
+    frame->cow = NULL;
+    lock_release(&frame_lock);
 
-    list_remove(&(frame->eviction_queue_list_elem));
-    
     // Free the page
     palloc_free_page(page);
 }
+
+// Hands the frame holding `page` over to the copy-on-write page `cow`,
+// unpinned. If `cow` is NULL, takes the frame back from its copy-on-write
+// page instead, pinned, for the current thread to install a page into.
+// The caller must hold `cow_lock`.
+void frametable_set_cow(void *page, struct cow_page *cow) {
+    ASSERT(lock_held_by_current_thread(&cow_lock));
+
+    lock_acquire(&frame_lock);
+    struct frame_info *frame = frame_for_page(page);
+    frame->owner = cow != NULL ? NULL : thread_current();
+    frame->page = NULL;
+    frame->cow = cow;
+    frame->is_pinned = cow == NULL;
+    lock_release(&frame_lock);
+}
+
+// Keeps the frame mapped at user address `upage` in `pagedir` from being
+// evicted until `frametable_unpin_user_page` is called for it. Returns
+// false if the page isn't in memory, or is on its way out: evictors pin a
+// frame with `frame_lock` held before unmapping it, so a frame that is
+// still mapped and not pinned then is safe to keep.
+bool frametable_pin_user_page(uint32_t *pagedir, void *upage) {
+    lock_acquire(&frame_lock);
+    void *kpage = pagedir_get_page(pagedir, upage);
+    bool pinned = kpage != NULL && !frame_for_page(kpage)->is_pinned;
+    if (pinned) frame_for_page(kpage)->pin_cnt++;
+    lock_release(&frame_lock);
+    return pinned;
+}
+
+// Lets the frame pinned at user address `upage` in `pagedir` be evicted
+// again, once every system call that pinned it is done.
+void frametable_unpin_user_page(uint32_t *pagedir, void *upage) {
+    lock_acquire(&frame_lock);
+    void *kpage = pagedir_get_page(pagedir, upage);
+    ASSERT(kpage != NULL);
+    ASSERT(frame_for_page(kpage)->pin_cnt > 0);
+    frame_for_page(kpage)->pin_cnt--;
+    lock_release(&frame_lock);
+}
+
+// Prints frame allocation and eviction statistics.
+void frametable_print_stats(void) {
+    printf("Frames: %lld allocated, %lld free on first try, "
+           "%lld evicted (%lld in background)\n",
+           allocation_cnt, free_hit_cnt, eviction_cnt, background_cnt);
+    printf("Clock: %lld frames scanned, %lld second chances, %lld skipped\n",
+           scan_cnt, second_chance_cnt, skip_cnt);
+}
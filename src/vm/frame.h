@@ -5,18 +5,41 @@
 #include <stdbool.h>
 #include "page.h"
 
+struct thread;
+struct text_page;
+struct cow_page;
+
 // Each instance of this struct stores metadata about one physical frame
 struct frame_info {
     bool is_user_page;
     bool is_pinned;
-    void* user_vaddr;
-    struct list_elem eviction_queue_list_elem;
+    // System calls using the page as a buffer, which keep it in memory
+    // until they're done with it, whoever else maps it.
+    unsigned pin_cnt;
+    // The reverse mapping: the process whose page is in the frame and
+    // that page's entry in its supplementary page table. Eviction may run
+    // on any thread, so it goes through the owner's page directory and
+    // page table, not its own. `page` is NULL while the frame is pinned
+    // for loading.
+    struct thread *owner;
+    struct page_info *page;
+    // Frames in the text cache, and frames holding copy-on-write pages,
+    // belong to no process. They have `text` or `cow` set instead of
+    // `owner` and `page`, and are evicted through the shared page, which
+    // knows all the processes mapping it.
+    struct text_page *text;
+    struct cow_page *cow;
 };
 
 void frametable_init(void);
 struct frame_info *frame_for_page(void *page);
 void *page_for_frame(struct frame_info *frame);
 void *frametable_create_page(enum palloc_flags flags);
+void *frametable_create_page_if_free(void);
 void frametable_free_page(void *page);
+void frametable_set_cow(void *page, struct cow_page *cow);
+bool frametable_pin_user_page(uint32_t *pagedir, void *upage);
+void frametable_unpin_user_page(uint32_t *pagedir, void *upage);
+void frametable_print_stats(void);
 
 #endif /* vm/frame.h */
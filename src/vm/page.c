@@ -1,14 +1,18 @@
 #include "vm/page.h"
 #include <hash.h>
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/init.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "userprog/pagedir.h"
+#include "vm/cow.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/text.h"
 
 // MARK: Page Table Element
 
@@ -54,11 +58,23 @@ struct page_info *pagetable_info_for_address(struct hash *pagetable,
 static void *_pagetable_load_page_from_swap(struct page_info *page);
 static void *_pagetable_load_page_from_file(struct page_info *page);
 static void *_pagetable_load_page_zero_initialized(struct page_info *page);
+static void _pagetable_install_loaded_page(struct page_info *page,
+                                           void *address);
 
 // This function should only be called by the page fault handler
 void pagetable_load_page(struct page_info *page) {
     void *address;
     
+    // Shared pages are mapped straight from what they share
+    if (page->shared.text) {
+        textcache_load_page(page);
+        return;
+    }
+    if (page->shared.cow != NULL) {
+        cow_load_page(page);
+        return;
+    }
+    
     // Check the state of the page and use the proper loading method
     switch (page->state) {
         case UNINITIALIZED_STATE:
@@ -104,14 +120,34 @@ void pagetable_load_page(struct page_info *page) {
             NOT_REACHED();
     }
     
+    _pagetable_install_loaded_page(page, address);
+}
+
+// Private function called once a page's contents are in the frame at
+// `address`, which is still pinned
+static void _pagetable_install_loaded_page(struct page_info *page,
+                                           void *address) {
     // Install the page into virtual memory, updating the page table
     pagedir_install_page(page->virtual_address, address, page->writable);
     
     // Update the page state
     page->state = LOADED_STATE;
-    // The page we got was pinned, now that it's done being initialized
-    // we need to unpin it.
-    frame_for_page(address)->is_pinned = false;
+    // Point the frame back at the page so eviction can find it, then
+    // unpin it. The page we got was pinned, now that it's done being
+    // initialized we need to unpin it.
+    struct frame_info *frame = frame_for_page(address);
+    frame->page = page;
+    frame->is_pinned = false;
+}
+
+// Gives the current process its own copy of the copy-on-write page
+// `page`, which it is about to write to, and maps it writable. This
+// should only be called by the page fault handler
+void pagetable_write_page(struct page_info *page) {
+    ASSERT(page->shared.cow != NULL);
+    ASSERT(page->writable);
+    
+    _pagetable_install_loaded_page(page, cow_unshare_page(page));
 }
 
 // Private function called by `pagetable_load_page`
@@ -121,16 +157,49 @@ static void *_pagetable_load_page_from_swap(struct page_info *page) {
     ASSERT(page->state == EVICTED_STATE);
     ASSERT(page->restoration_method == SWAP_RESTORATION);
     
+    struct page_info *pages[SWAP_CLUSTER_PAGES];
+    void *frames[SWAP_CLUSTER_PAGES];
+    size_t cnt = 1;
+    size_t i;
+    
     // Create frame page
-    void *f = frametable_create_page(0);
-    struct frame_info* fi = frame_for_page(f);
-    fi->user_vaddr = page->virtual_address;
+    pages[0] = page;
+    frames[0] = frametable_create_page(0);
     ASSERT(is_user_vaddr(page->virtual_address));
-
-    // Swap page into memory
-    load_swapped_page_into_frame(page, f);
     
-    return f;
+    // Read around the page: the pages of this process that were swapped
+    // out alongside it will most likely be wanted soon too, and they come
+    // in with the same transfer. Only do this with frames that are free
+    // anyway, since evicting for a guess would be a bad trade.
+    struct page_info *neighbors[SWAP_CLUSTER_PAGES - 1];
+    size_t neighbor_cnt = find_swapped_neighbors(page,
+                                                 thread_current()->pagedir,
+                                                 neighbors,
+                                                 SWAP_CLUSTER_PAGES - 1);
+    for (i = 0; i < neighbor_cnt; i++) {
+        ASSERT(neighbors[i]->restoration_method == SWAP_RESTORATION);
+        
+        // Pages that kept their slots may be in memory already
+        if (neighbors[i]->state != EVICTED_STATE) continue;
+        
+        void *f = frametable_create_page_if_free();
+        if (f == NULL) break;
+        pages[cnt] = neighbors[i];
+        frames[cnt] = f;
+        cnt++;
+    }
+    
+    // Swap the pages into memory
+    load_swapped_pages_into_frames(pages, frames, cnt);
+    
+    // Map the neighbors right away so they don't fault at all. They
+    // aren't marked accessed, so the clock takes them back first if
+    // they turn out not to be used.
+    for (i = 1; i < cnt; i++) {
+        _pagetable_install_loaded_page(pages[i], frames[i]);
+    }
+    
+    return frames[0];
 }
 
 // Private function called by `pagetable_load_page`
@@ -144,8 +213,6 @@ static void *_pagetable_load_page_from_file(struct page_info *page) {
     
     // Create frame page
     void *f = frametable_create_page(0);
-    struct frame_info* fi = frame_for_page(f);
-    fi->user_vaddr = page->virtual_address;
     ASSERT(is_user_vaddr(page->virtual_address));
     
     // Read the file into the newly created page
@@ -172,8 +239,6 @@ static void *_pagetable_load_page_zero_initialized(struct page_info *page) {
     ASSERT(page->initialization_method == ZERO_INITIALIZATION);
     
     void *f = frametable_create_page(PAL_ZERO);
-    struct frame_info* fi = frame_for_page(f);
-    fi->user_vaddr = page->virtual_address;
     ASSERT(is_user_vaddr(page->virtual_address));
 
     return f;
@@ -183,49 +248,85 @@ static void *_pagetable_load_page_zero_initialized(struct page_info *page) {
 
 static void _pagetable_cleanup_page(struct page_info *page);
 
-static void _pagetable_evict_page_to_swap(struct page_info *page);
-static void _pagetable_evict_page_to_file(struct page_info *page);
-
-// Evict the given page without freeing its frame. Returns the kernel address
-// of the page's memory.
-void *pagetable_evict_page(struct page_info *page) {
-    ASSERT(page->state == LOADED_STATE);
-
-    // Evict the page using a method that matches its restoration
-    switch (page->restoration_method) {
-        case SWAP_RESTORATION:
-            _pagetable_evict_page_to_swap(page);
-            break;
-            
-        case FILE_RESTORATION:
-            _pagetable_evict_page_to_file(page);
-            break;
-            
-        default:
-            NOT_REACHED();
-    }
-    
-    // Update the page state
-    page->state = EVICTED_STATE;
-    
-    // Uninstall page from virtual memory, updating the page table
-    return pagedir_uninstall_page(page->virtual_address);
+static void _pagetable_evict_page_to_file(struct page_info *page,
+                                          uint32_t *pagedir, void *kpage);
+
+// Evict the given page, which is mapped in `pagedir`, without freeing its
+// frame. Returns the kernel address of the page's memory. This may be
+// called from a thread other than the page's owner, as long as it holds
+// the owner's pagetable lock.
+void *pagetable_evict_page(struct page_info *page, uint32_t *pagedir) {
+    void *kpage;
+    pagetable_evict_pages(&page, &pagedir, &kpage, 1);
+    return kpage;
 }
 
-// Private function called by `pagetable_evict_page`
-static void _pagetable_evict_page_to_swap(struct page_info *page) {
-    // Perform sanity checks
-    ASSERT(page->state == LOADED_STATE)
-    ASSERT(page->restoration_method == SWAP_RESTORATION);
+// Evict up to SWAP_CLUSTER_PAGES pages at once, each mapped in the
+// matching entry of `pagedirs`, without freeing their frames. Stores the
+// kernel address of each page's memory in `kpages`. The pages that go to
+// swap are written out together as one cluster. The caller must hold
+// the pagetable lock of every page's owner.
+void pagetable_evict_pages(struct page_info **pages, uint32_t **pagedirs,
+                           void **kpages, size_t cnt) {
+    struct page_info *cluster[SWAP_CLUSTER_PAGES];
+    uint32_t *cluster_pagedirs[SWAP_CLUSTER_PAGES];
+    void *cluster_kpages[SWAP_CLUSTER_PAGES];
+    size_t cluster_cnt = 0;
+    size_t i;
+
+    ASSERT(cnt <= SWAP_CLUSTER_PAGES);
+    
+    // Uninstall the pages from virtual memory first, updating the page
+    // tables, so that their owners can't modify them while they're being
+    // saved. They will fault instead, and wait on their pagetable locks
+    // for us to finish.
+    for (i = 0; i < cnt; i++) {
+        ASSERT(pages[i]->state == LOADED_STATE);
+        ASSERT(!pages[i]->shared.text && pages[i]->shared.cow == NULL);
+        kpages[i] = pagedir_uninstall_page(pagedirs[i],
+                                           pages[i]->virtual_address);
+    }
     
-    // Return early if we shouldn't actually swap.
-    if (page->swap_info.swap_index == DO_NOT_SWAP_INDEX) return;
+    // Save each page using a method that matches its restoration
+    for (i = 0; i < cnt; i++) {
+        switch (pages[i]->restoration_method) {
+            case SWAP_RESTORATION:
+                // Skip pages we shouldn't actually swap, and gather
+                // up the rest to write together.
+                if (pages[i]->swap_info.swap_index == DO_NOT_SWAP_INDEX) break;
+                // Pages swapped in earlier whose copy in swap is
+                // still good don't have to be written at all.
+                if (keep_swapped_copy(pages[i],
+                                      pagedir_is_dirty(pagedirs[i],
+                                          pages[i]->virtual_address))) break;
+                cluster[cluster_cnt] = pages[i];
+                cluster_pagedirs[cluster_cnt] = pagedirs[i];
+                cluster_kpages[cluster_cnt] = kpages[i];
+                cluster_cnt++;
+                break;
+                
+            case FILE_RESTORATION:
+                _pagetable_evict_page_to_file(pages[i], pagedirs[i], kpages[i]);
+                break;
+                
+            default:
+                NOT_REACHED();
+        }
+    }
+    if (cluster_cnt > 0) {
+        add_pages_to_swapfile(cluster, cluster_pagedirs, cluster_kpages,
+                              cluster_cnt);
+    }
     
-    add_page_to_swapfile(page);
+    // Update the page states
+    for (i = 0; i < cnt; i++) {
+        pages[i]->state = EVICTED_STATE;
+    }
 }
 
-// Private function called by `pagetable_evict_page`
-static void _pagetable_evict_page_to_file(struct page_info *page) {
+// Private function called by `pagetable_evict_pages`
+static void _pagetable_evict_page_to_file(struct page_info *page,
+                                          uint32_t *pagedir, void *kpage) {
     // Perform sanity checks
     ASSERT(page->state == LOADED_STATE)
     ASSERT(page->restoration_method == FILE_RESTORATION);
@@ -234,17 +335,22 @@ static void _pagetable_evict_page_to_file(struct page_info *page) {
     if (!page->writable) return;
     
     // Skip writing pages that aren't dirty back to disk
-    if (!pagedir_is_dirty(thread_current()->pagedir, page->virtual_address))
+    if (!pagedir_is_dirty(pagedir, page->virtual_address))
         return;
     
     // Write file to disk
     off_t bytes_written = file_write_at(page->file_info.file,
-                                        page->virtual_address,
+                                        kpage,
                                         page->file_info.num_bytes,
                                         page->file_info.offset);
-        
-    // Make sure that file was actually written to.
-    ASSERT(bytes_written == (off_t)page->file_info.num_bytes);
+
+    // The file can't be written while it's running as a program, and a
+    // user process mustn't be able to take the kernel down by mapping
+    // one, so the changes are lost instead.
+    if (bytes_written != (off_t)page->file_info.num_bytes) {
+        printf("Dropped changes to a mapped page at offset %d of a file "
+               "that can't be written.\n", (int)page->file_info.offset);
+    }
 }
 
 // MARK: Page Installation
@@ -278,6 +384,10 @@ static void _pagetable_install_page(struct hash *pagetable,
 
     The pages initialized by this function must be writable by the user process
     if WRITABLE is true, read-only otherwise.
+
+    The pages read from FILE itself rather than from a reopened copy, so it
+    must stay open for as long as they're installed, as a process keeps its
+    executable open.
 */
 void pagetable_install_segment(struct hash *pagetable,
                                struct file *file,
@@ -291,12 +401,6 @@ void pagetable_install_segment(struct hash *pagetable,
     ASSERT(offset % PGSIZE == 0);
     
     while (num_bytes > 0 || zero_bytes > 0) {
-        // Reopen the file
-        struct file *reopened_file;
-        if (!(reopened_file = file_reopen(file))) {
-            PANIC("Failed to reopen file.");
-        }
-        
         /* Calculate how to fill this page.
            We will read PAGE_num_bytes bytes from FILE
            and zero the final PAGE_ZERO_BYTES bytes. */
@@ -309,14 +413,20 @@ void pagetable_install_segment(struct hash *pagetable,
             PANIC("Unable to allocate memory to store page_info.");
         }
         
-        // Initialize the properties
+        // Initialize the properties. Read-only pages never change,
+        // so they are shared and reread from the file when evicted,
+        // while the rest go to swap once they've been loaded.
         page->virtual_address = address;
         page->initialization_method = FILE_INITIALIZATION;
-        page->restoration_method = SWAP_RESTORATION;
+        page->restoration_method = writable ? SWAP_RESTORATION
+                                            : FILE_RESTORATION;
         page->writable = writable;
+        page->has_swap_slot = false;
+        page->shared.text = !writable;
+        page->shared.cow = NULL;
         
         // Initialize the load data
-        page->file_info.file = reopened_file;
+        page->file_info.file = file;
         page->file_info.offset = offset;
         page->file_info.num_bytes = page_num_bytes;
         page->file_info.next = NULL; // We aren't going to unmap.
@@ -342,7 +452,7 @@ void pagetable_install_file(struct hash *pagetable,
     
     // Compute how many pages are necessary to store the file
     off_t length = file_length(file);
-    int num_pages = pg_count(length);
+    int num_pages = DIV_ROUND_UP(length, PGSIZE);
     
     // Loop over the pages in reverse setting up pointers to the next page
     int i;
@@ -365,10 +475,14 @@ void pagetable_install_file(struct hash *pagetable,
         page->initialization_method = FILE_INITIALIZATION;
         page->restoration_method = FILE_RESTORATION;
         page->writable = writable;
+        page->has_swap_slot = false;
+        page->shared.text = false;
+        page->shared.cow = NULL;
         
-        // Compute the number of bytes to read
-        bool final_page = i == (num_pages - 1);
-        uint32_t num_bytes = final_page ? (length % PGSIZE) : PGSIZE;
+        // Compute the number of bytes to read, which is less than
+        // a full page only at the end of the file
+        off_t remaining = length - (i * PGSIZE);
+        uint32_t num_bytes = remaining < PGSIZE ? remaining : PGSIZE;
         
         // Initialize the load data
         page->file_info.file = reopened_file;
@@ -397,7 +511,7 @@ static void _pagetable_uninstall_file_page(struct page_info *page, bool cleanup)
         case LOADED_STATE:
             // Evict the file, writing it to disk
             // Let the frame table know we're no longer using this frame
-            frametable_free_page(pagetable_evict_page(page));
+            frametable_free_page(pagetable_evict_page(page, thread_current()->pagedir));
             break;
             
         default:
@@ -466,6 +580,23 @@ void pagetable_install_allocation(struct hash *pagetable, void *address) {
     _pagetable_install_page(pagetable, page);
 }
 
+// MARK: Stack Growth
+
+// Whether the given user address lies in the region reserved for the stack.
+bool pagetable_is_stack_address(void *address) {
+    return is_user_vaddr(address) &&
+           (uint8_t *)address >= (uint8_t *)PHYS_BASE - STACK_MAX_SIZE;
+}
+
+// Whether an access to the given address, which has no page yet, should
+// grow the stack down to it, given the user stack pointer at the time.
+// Anything at or above the stack pointer is fair game, as is anything
+// within the buffer zone just below it.
+bool pagetable_is_stack_access(void *address, void *esp) {
+    return pagetable_is_stack_address(address) &&
+           (uint8_t *)address >= (uint8_t *)esp - STACK_BUFFER_ZONE;
+}
+
 // Uninstall a allocated page from virtual memory. Assumes that
 // the file that was installed using `pagetable_allocate`.
 static void _pagetable_uninstall_allocation(struct page_info *page, bool cleanup) {
@@ -485,10 +616,12 @@ static void _pagetable_uninstall_allocation(struct page_info *page, bool cleanup
             break;
             
         case LOADED_STATE:
-            // Evict the file without writing it to swap
+            // Evict the file without writing it to swap, giving up
+            // any slot it kept from an earlier swap-in
             // Let the frame table know we're no longer using this frame
+            if (page->has_swap_slot) delete_swapped_page(page);
             page->swap_info.swap_index = DO_NOT_SWAP_INDEX;
-            frametable_free_page(pagetable_evict_page(page));
+            frametable_free_page(pagetable_evict_page(page, thread_current()->pagedir));
             break;
             
         default:
@@ -499,6 +632,179 @@ static void _pagetable_uninstall_allocation(struct page_info *page, bool cleanup
     if (cleanup) _pagetable_cleanup_page(page);
 }
 
+// MARK: Pinning
+
+// Brings the page of the current process at user address `address` into
+// memory and pins it there, so that a system call can use it as a buffer
+// while it holds locks that the page fault handler might need. If `write`
+// is set, the page has to be writable, and a copy-on-write page gets its
+// own copy first. The stack grows down to `address` if it looks like a
+// push. Returns false if the process has no such page.
+bool pagetable_pin_page(void *address, bool write) {
+    struct thread *t = thread_current();
+    void *upage = pg_round_down(address);
+    bool pinned = false;
+    
+    lock_acquire(&t->pagetable_lock);
+    struct page_info *page = pagetable_info_for_address(&t->pagetable,
+                                                        address);
+    if (page == NULL && pagetable_is_stack_access(address, t->user_esp)) {
+        pagetable_install_allocation(&t->pagetable, upage);
+        page = pagetable_info_for_address(&t->pagetable, upage);
+    }
+    
+    if (page != NULL && (page->writable || !write)) {
+        // Shared pages can be evicted without our lock, so it may take a
+        // few tries to catch one in memory
+        while (!pinned) {
+            if (write && page->shared.cow != NULL) {
+                pagetable_write_page(page);
+            } else if (page->state != LOADED_STATE) {
+                pagetable_load_page(page);
+            }
+            pinned = frametable_pin_user_page(t->pagedir, upage);
+            if (!pinned) thread_yield();
+        }
+    }
+    lock_release(&t->pagetable_lock);
+    return pinned;
+}
+
+// Lets a page pinned by `pagetable_pin_page` be evicted again.
+void pagetable_unpin_page(void *address) {
+    frametable_unpin_user_page(thread_current()->pagedir,
+                               pg_round_down(address));
+}
+
+// MARK: Shared Pages
+
+// Maps shared contents at `kpage` into the current process at `page`,
+// read-only, and adds the page to `mappings`, the pages mapping those
+// contents. The caller must hold the lock that guards `mappings`.
+void pagetable_map_shared(struct page_info *page, void *kpage,
+                          struct list *mappings) {
+    pagedir_install_page(page->virtual_address, kpage, false);
+    page->shared.pagedir = thread_current()->pagedir;
+    list_push_back(mappings, &page->shared.elem);
+    page->state = LOADED_STATE;
+}
+
+// Unmaps a shared page from its process, if it's mapped. The caller must
+// hold the lock that guards the list of mappings it's on.
+void pagetable_unmap_shared(struct page_info *page) {
+    if (page->state != LOADED_STATE) return;
+    
+    pagedir_uninstall_page(page->shared.pagedir, page->virtual_address);
+    list_remove(&page->shared.elem);
+    page->state = EVICTED_STATE;
+}
+
+// Unmaps shared contents from all of `mappings`, whichever processes the
+// pages belong to. Each page is marked evicted before it's unmapped, so
+// that a process faulting on it right away waits on the lock guarding
+// `mappings`, which the caller must hold, to map it again.
+void pagetable_unmap_all_shared(struct list *mappings) {
+    while (!list_empty(mappings)) {
+        struct list_elem *e = list_pop_front(mappings);
+        struct page_info *page = list_entry(e, struct page_info, shared.elem);
+        page->state = EVICTED_STATE;
+        pagedir_uninstall_page(page->shared.pagedir, page->virtual_address);
+    }
+}
+
+// Whether shared contents at `kpage` have been used, through any of
+// `mappings` or the kernel's alias of the frame, since their accessed bits
+// were last reset. If `clear` is set, resets all of them. The caller must
+// hold the lock that guards `mappings`.
+bool pagetable_shared_accessed(struct list *mappings, void *kpage,
+                               bool clear) {
+    // Every page directory shares the kernel's page tables
+    bool accessed = pagedir_is_accessed(init_page_dir, kpage);
+    if (clear) pagedir_set_accessed(init_page_dir, kpage, false);
+    
+    struct list_elem *e;
+    for (e = list_begin(mappings); e != list_end(mappings);
+         e = list_next(e)) {
+        struct page_info *page = list_entry(e, struct page_info, shared.elem);
+        if (pagedir_is_accessed(page->shared.pagedir, page->virtual_address)) {
+            accessed = true;
+            if (clear) pagedir_set_accessed(page->shared.pagedir,
+                                            page->virtual_address, false);
+        }
+    }
+    return accessed;
+}
+
+// MARK: Forking
+
+// Fills the empty supplementary page table of a new child process with
+// copies of the pages of its parent, whose page table is
+// `parent_pagetable` and page directory `parent_pagedir`. Pages with
+// contents are shared with the parent copy-on-write. The rest will be
+// loaded from scratch, from the child's own `executable` or its own
+// handles on the mapped files. The caller must hold both processes'
+// pagetable locks.
+void pagetable_fork(struct hash *pagetable, struct hash *parent_pagetable,
+                    uint32_t *parent_pagedir, struct file *executable) {
+    struct hash_iterator i;
+    
+    hash_first(&i, parent_pagetable);
+    while (hash_next(&i)) {
+        struct page_info *page = hash_entry(hash_cur(&i), struct page_info,
+                                            hash_elem);
+        
+        // Allocate a page
+        struct page_info *copy = malloc(sizeof(struct page_info));
+        if (copy == NULL) {
+            PANIC("Unable to allocate memory to store page_info.");
+        }
+        
+        // Start from the parent's page, not loaded
+        *copy = *page;
+        copy->state = UNINITIALIZED_STATE;
+        copy->has_swap_slot = false;
+        
+        if (page->shared.text) {
+            // Executable pages come from the text cache either way
+            copy->file_info.file = executable;
+        } else if (page->restoration_method == FILE_RESTORATION) {
+            // The child reads mapped files in again, so write back what
+            // the parent has changed first
+            if (page->state == LOADED_STATE) {
+                _pagetable_evict_page_to_file(page, parent_pagedir,
+                    pagedir_get_page(parent_pagedir, page->virtual_address));
+            }
+            copy->file_info.file = file_reopen(page->file_info.file);
+            if (copy->file_info.file == NULL) {
+                PANIC("Failed to reopen file.");
+            }
+        } else if (page->state == UNINITIALIZED_STATE) {
+            // Nothing to share yet
+            if (page->initialization_method == FILE_INITIALIZATION) {
+                copy->file_info.file = executable;
+            }
+        } else {
+            cow_share_page(page, parent_pagedir, copy);
+        }
+        
+        // Insert the page into the pagetable
+        struct hash_elem *existing = hash_insert(pagetable, &copy->hash_elem);
+        ASSERT(existing == NULL);
+    }
+    
+    // Chain the pages of each mapped file together like the parent's
+    hash_first(&i, pagetable);
+    while (hash_next(&i)) {
+        struct page_info *copy = hash_entry(hash_cur(&i), struct page_info,
+                                            hash_elem);
+        if (copy->restoration_method == FILE_RESTORATION &&
+            !copy->shared.text && copy->file_info.next != NULL) {
+            copy->file_info.next = pagetable_info_for_address(pagetable,
+                copy->file_info.next->virtual_address);
+        }
+    }
+}
+
 // MARK: Uninstallation
 
 static void _pagetable_uninstall(struct page_info *page, bool cleanup);
@@ -521,6 +827,22 @@ static void _pagetable_cleanup_page(struct page_info *page) {
 }
 
 static void _pagetable_uninstall(struct page_info *page, bool cleanup) {
+    // Shared pages just stop mapping the cached page, which stays
+    // cached for whoever runs the executable next
+    if (page->shared.text) {
+        textcache_unload_page(page);
+        if (cleanup) _pagetable_cleanup_page(page);
+        return;
+    }
+    
+    // Copy-on-write pages give up their share of the contents, which
+    // are freed along with the last share
+    if (page->shared.cow != NULL) {
+        cow_unload_page(page);
+        if (cleanup) _pagetable_cleanup_page(page);
+        return;
+    }
+    
     switch (page->restoration_method) {
         case SWAP_RESTORATION:
             // Uninstall an allocated page
@@ -2,6 +2,7 @@
 #define VM_PAGE_H
 
 #include <hash.h>
+#include <list.h>
 #include <stdbool.h>
 #include "filesys/file.h"
 #include "threads/vaddr.h"
@@ -9,6 +10,13 @@
 // Index that indicates the file should be discarded instead of swapped.
 #define DO_NOT_SWAP_INDEX (-1)
 
+// The furthest the stack may grow down from PHYS_BASE.
+#define STACK_MAX_SIZE (8 * 1024 * 1024)
+
+// How far below the stack pointer an access still counts as a push.
+// PUSHA writes 32 bytes below it, so leave some room past that.
+#define STACK_BUFFER_ZONE 64
+
 // Supplementary page info associated with a page telling us
 // how to initialize, load, and evict it.
 struct page_info {
@@ -66,11 +74,35 @@ struct page_info {
     // to completely toss the data.
     bool writable;
     
+    // Whether the page has a slot in swap. This stays set after the
+    // page is swapped back in, so that as long as the page isn't
+    // modified, evicting it again needs no I/O. Only pages with the
+    // `SWAP_RESTORATION` restoration method have slots.
+    bool has_swap_slot;
+    
+    // Pages shared with other processes: read-only pages of an
+    // executable, shared by every process running it through the text
+    // cache in vm/text.c and simply dropped on eviction, and the pages
+    // a process had when it forked, shared copy-on-write with its child
+    // through vm/cow.c until one of them writes to the page.
+    struct {
+        // Whether the page goes through the text cache.
+        bool text;
+        
+        // The copy-on-write page whose contents the page shares, or NULL.
+        struct cow_page *cow;
+        
+        // While a shared page is loaded, the page directory it's mapped
+        // in, read-only, and the element in the list of mappings of
+        // the page it shares.
+        uint32_t *pagedir;
+        struct list_elem elem;
+    } shared;
+    
     // The data that's used to load the page, either for
     // initialization or after eviction.
     union {
-        // If the restoration method is `SWAP_RESTORATION` and
-        // the state is `EVICTED_STATE`, this stores the info
+        // If `has_swap_slot` is set, this stores the info
         // necessary to load the page back from swap. Otherwise,
         // this contains junk and it is illegal to modify it.
         struct {
@@ -110,7 +142,9 @@ void uninstall_page(struct hash_elem *e, void *aux UNUSED);
 struct page_info *pagetable_info_for_address(struct hash *pagetable,
                                              void *address);
 void pagetable_load_page(struct page_info *page);
-void *pagetable_evict_page(struct page_info *page);
+void *pagetable_evict_page(struct page_info *page, uint32_t *pagedir);
+void pagetable_evict_pages(struct page_info **pages, uint32_t **pagedirs,
+                           void **kpages, size_t cnt);
 
 void pagetable_install_file(struct hash *pagetable,
                             struct file *file,
@@ -128,6 +162,23 @@ void pagetable_uninstall_file(struct page_info *page);
 void pagetable_install_allocation(struct hash *pagetable, void *address);
 void pagetable_install_and_load_allocation(struct hash *pagetable, void *address);
 
+bool pagetable_is_stack_address(void *address);
+bool pagetable_is_stack_access(void *address, void *esp);
+
+bool pagetable_pin_page(void *address, bool write);
+void pagetable_unpin_page(void *address);
+
+void pagetable_map_shared(struct page_info *page, void *kpage,
+                          struct list *mappings);
+void pagetable_unmap_shared(struct page_info *page);
+void pagetable_unmap_all_shared(struct list *mappings);
+bool pagetable_shared_accessed(struct list *mappings, void *kpage,
+                               bool clear);
+void pagetable_write_page(struct page_info *page);
+
+void pagetable_fork(struct hash *pagetable, struct hash *parent_pagetable,
+                    uint32_t *parent_pagedir, struct file *executable);
+
 void pagetable_uninstall_all(struct hash *pagetable);
 void pagetable_uninstall(struct page_info *page);
 
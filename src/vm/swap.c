@@ -1,7 +1,9 @@
 #include "vm/swap.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdio.h>
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -10,61 +12,254 @@ static struct bitmap* swapmap; // This has an "occupied" boolean bit for
 static struct block* swap_block;
 static struct lock swap_lock;
 
+// Slot allocation is next-fit: each search starts where the last one
+// left off, so pages evicted one after another land in consecutive
+// slots and go out to the disk as one sequential stream.
+static size_t swap_cursor;
+
+// Slots in use, including those kept by pages that are back in memory.
+static size_t used_slot_cnt;
+
+// The page in each occupied slot, and the page directory of the process
+// it belongs to, so that a swap-in can find the pages of the same address
+// space that were swapped out next to it.
+static struct page_info** slot_pages;
+static uint32_t** slot_pagedirs;
+
+// Swap statistics.
+static long long write_cnt;             // Pages written.
+static long long cluster_cnt;           // ...in this many clusters.
+static long long read_cnt;              // Pages read.
+static long long swap_in_cnt;           // ...by this many swap-ins.
+static long long clean_cnt;             // Evictions that kept their slot.
+
 void swaptable_init(void) {
 	swap_block = block_get_role(BLOCK_SWAP);
 
 	lock_init(&swap_lock);
 
-	block_sector_t swapfile_numsectors = block_size(swap_block);
+	// Without a swap device there are simply no slots to hand out
+	block_sector_t swapfile_numsectors =
+	    swap_block != NULL ? block_size(swap_block) : 0;
 	uint32_t swapfile_numbytes = swapfile_numsectors * BLOCK_SECTOR_SIZE;
 	uint32_t swapfile_numpages = swapfile_numbytes / PGSIZE;
 
 	swapmap = bitmap_create(swapfile_numpages);
+	slot_pages = calloc(swapfile_numpages + 1, sizeof *slot_pages);
+	slot_pagedirs = calloc(swapfile_numpages + 1, sizeof *slot_pagedirs);
+	if (swapmap == NULL || slot_pages == NULL || slot_pagedirs == NULL)
+		PANIC("Unable to allocate the swap table.");
+}
+
+// Must be called with `swap_lock` held. Frees the given slot.
+static void free_slot(size_t index) {
+	bitmap_reset(swapmap, index);
+	used_slot_cnt--;
+	slot_pages[index] = NULL;
+	slot_pagedirs[index] = NULL;
+}
+
+// Must be called with `swap_lock` held. Reserves a run of consecutive free
+// slots, as many as possible up to `cnt`, and returns the first of them,
+// storing the number reserved in `got`.
+static size_t allocate_slots(size_t cnt, size_t* got) {
+	size_t slot_cnt = bitmap_size(swapmap);
+
+	// Look for the whole run from the cursor onward, then from the
+	// start, settling for shorter runs if need be
+	for (; cnt > 0; cnt /= 2) {
+		size_t index = bitmap_scan(swapmap, swap_cursor, cnt, false);
+		if (index == BITMAP_ERROR && swap_cursor > 0)
+			index = bitmap_scan(swapmap, 0, cnt, false);
+		if (index != BITMAP_ERROR) {
+			bitmap_set_multiple(swapmap, index, cnt, true);
+			used_slot_cnt += cnt;
+			swap_cursor = index + cnt < slot_cnt ? index + cnt : 0;
+			*got = cnt;
+			return index;
+		}
+	}
+	PANIC("Out of swap slots.");
+}
+
+// Called by the block layer when one page of a transfer is done.
+static void swap_transfer_done(struct block_request* r) {
+	sema_up(r->aux);
+}
+
+// Reads or writes the `cnt` pages at `kpages` from or to their slots, all
+// at once, so that the block layer merges adjacent slots into a single
+// transfer. Returns when all of them are done.
+static void transfer_pages(struct page_info** pages, void** kpages,
+                           size_t cnt, bool write) {
+	struct block_request requests[SWAP_CLUSTER_PAGES];
+	struct semaphore done;
+	size_t i;
+
+	ASSERT(cnt <= SWAP_CLUSTER_PAGES);
+	sema_init(&done, 0);
+
+	for (i = 0; i < cnt; i++) {
+		struct block_request* r = &requests[i];
+		r->sector = pages[i]->swap_info.swap_index * SECTORS_PER_PAGE;
+		r->cnt = SECTORS_PER_PAGE;
+		r->buffer = kpages[i];
+		r->write = write;
+		r->complete = swap_transfer_done;
+		r->aux = &done;
+		block_submit(swap_block, r);
+	}
+	for (i = 0; i < cnt; i++)
+		sema_down(&done);
 }
 
-void add_page_to_swapfile(struct page_info* p) {
+// Writes the `cnt` pages whose contents are at `kpages`, each belonging to
+// the process with the matching page directory in `pagedirs`, to swap,
+// recording each one's slot in its page_info. The slots are reserved as
+// consecutive runs and written together.
+void add_pages_to_swapfile(struct page_info** pages, uint32_t** pagedirs,
+                           void** kpages, size_t cnt) {
+	size_t i = 0;
+
+	ASSERT(cnt <= SWAP_CLUSTER_PAGES);
+	for (i = 0; i < cnt; i++)
+		ASSERT(!pages[i]->has_swap_slot);
+	i = 0;
+
+	// Reserve the slots. The I/O itself doesn't need the lock.
 	lock_acquire(&swap_lock);
+	while (i < cnt) {
+		size_t got;
+		size_t index = allocate_slots(cnt - i, &got);
+		for (; got > 0; got--, index++, i++) {
+			pages[i]->swap_info.swap_index = index;
+			pages[i]->has_swap_slot = true;
+			slot_pages[index] = pages[i];
+			slot_pagedirs[index] = pagedirs[i];
+		}
+	}
+	write_cnt += cnt;
+	cluster_cnt++;
+	lock_release(&swap_lock);
+
+	transfer_pages(pages, kpages, cnt, true);
+}
 
-	// Find the first open 4KB slot in the swap file
-	unsigned int index = bitmap_scan_and_flip(swapmap, 0, 1, false);
-	ASSERT(index != BITMAP_ERROR);
-	ASSERT(bitmap_test(swapmap, index));  // should be true i.e. occupied
-
-	// Write out the passed-in page to that 4KB slot
-	// We're going to need to write out eight sectors, one at a time
-	block_sector_t sector_index = index * SECTORS_PER_PAGE;
-	int i;
-	for(i = 0; i < SECTORS_PER_PAGE; i++) {
-		block_sector_t target_sector = sector_index + i;
-		void* source_buf = (uint8_t *)p->virtual_address + (i * BLOCK_SECTOR_SIZE);
-		block_write(swap_block, target_sector, source_buf);
+void add_page_to_swapfile(struct page_info* p, uint32_t* pagedir,
+                          void* kpage) {
+	add_pages_to_swapfile(&p, &pagedir, &kpage, 1);
+}
+
+// Finds the other pages of the process with page directory `pagedir` that
+// have slots near page `p`'s, within the cluster-aligned window of slots
+// around its own, and stores up to `max` of them in `neighbors`. Returns
+// how many were found. Some of them may be back in memory already.
+size_t find_swapped_neighbors(struct page_info* p, uint32_t* pagedir,
+                              struct page_info** neighbors, size_t max) {
+	size_t index = p->swap_info.swap_index;
+	size_t start = index - index % SWAP_CLUSTER_PAGES;
+	size_t end = start + SWAP_CLUSTER_PAGES;
+	size_t cnt = 0;
+	size_t i;
+
+	lock_acquire(&swap_lock);
+	if (end > bitmap_size(swapmap))
+		end = bitmap_size(swapmap);
+	for (i = start; i < end && cnt < max; i++) {
+		if (i != index && slot_pagedirs[i] == pagedir)
+			neighbors[cnt++] = slot_pages[i];
 	}
+	lock_release(&swap_lock);
+	return cnt;
+}
 
-	p->swap_info.swap_index = index;
+// Reads the `cnt` swapped-out pages into the matching `frames` together.
+// The pages keep their slots, so that they can be evicted again for free
+// if they aren't modified, unless swap is more than half full, in which
+// case the slots are freed for pages that have nowhere else to go.
+void load_swapped_pages_into_frames(struct page_info** pages, void** frames,
+                                    size_t cnt) {
+	size_t i;
+
+	// The slots stay reserved until the reads are done, so that
+	// nobody can write over them in the meantime
+	transfer_pages(pages, frames, cnt, false);
+
+	lock_acquire(&swap_lock);
+	if (used_slot_cnt * 2 > bitmap_size(swapmap)) {
+		for (i = 0; i < cnt; i++) {
+			free_slot(pages[i]->swap_info.swap_index);
+			pages[i]->has_swap_slot = false;
+		}
+	}
+	read_cnt += cnt;
+	swap_in_cnt++;
 	lock_release(&swap_lock);
 }
 
 void load_swapped_page_into_frame(struct page_info* p, void* frame) {
+	load_swapped_pages_into_frames(&p, &frame, 1);
+}
+
+// Reads page `p` from swap into `frame`, leaving its slot alone, for
+// pages whose contents other pages still share.
+void copy_swapped_page_into_frame(struct page_info* p, void* frame) {
+	ASSERT(p->has_swap_slot);
+	transfer_pages(&p, &frame, 1, false);
+
 	lock_acquire(&swap_lock);
-	int index = p->swap_info.swap_index;
-	bitmap_reset(swapmap, index);
+	read_cnt++;
+	swap_in_cnt++;
+	lock_release(&swap_lock);
+}
+
+// Hands page `from`'s slot over to page `to`, which belongs to the process
+// with page directory `pagedir`, or to none if it's NULL.
+void move_swapped_page(struct page_info* from, struct page_info* to,
+                       uint32_t* pagedir) {
+	ASSERT(from->has_swap_slot && !to->has_swap_slot);
+
+	lock_acquire(&swap_lock);
+	size_t index = from->swap_info.swap_index;
+	to->swap_info.swap_index = index;
+	to->has_swap_slot = true;
+	from->has_swap_slot = false;
+	slot_pages[index] = to;
+	slot_pagedirs[index] = pagedir;
+	lock_release(&swap_lock);
+}
 
-	// Read the 4KB page from disk to the passed-in frame
-	// We're going to need to read out eight sectors, one at a time
-	block_sector_t sector_index = index * SECTORS_PER_PAGE;
-	int i;
-	for (i = 0; i < SECTORS_PER_PAGE; i++) {
-		block_sector_t source_sector = sector_index + i;
-		void* target_buf = (uint8_t *)frame + (i * BLOCK_SECTOR_SIZE);
-		block_read(swap_block, source_sector, target_buf);
+// Called when page `p`, which kept its slot when it was swapped in, is
+// evicted again. If the page hasn't been modified since, as given by
+// `dirty`, the slot still holds its contents: it keeps the slot and this
+// returns true. Otherwise the stale slot is freed and the page needs to be
+// written out again.
+bool keep_swapped_copy(struct page_info* p, bool dirty) {
+	if (!p->has_swap_slot)
+		return false;
+	if (dirty) {
+		delete_swapped_page(p);
+		return false;
 	}
 
+	lock_acquire(&swap_lock);
+	clean_cnt++;
 	lock_release(&swap_lock);
+	return true;
 }
 
 void delete_swapped_page(struct page_info* p) {
+    ASSERT(p->has_swap_slot);
     lock_acquire(&swap_lock);
-    int index = p->swap_info.swap_index;
-    bitmap_reset(swapmap, index);
+    free_slot(p->swap_info.swap_index);
+    p->has_swap_slot = false;
     lock_release(&swap_lock);
 }
+
+// Prints swap statistics.
+void swap_print_stats(void) {
+	printf("Swap: %lld pages written in %lld clusters, "
+	       "%lld pages read in %lld swap-ins, "
+	       "%lld clean evictions\n",
+	       write_cnt, cluster_cnt, read_cnt, swap_in_cnt, clean_cnt);
+}
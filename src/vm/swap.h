@@ -1,13 +1,30 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include "devices/block.h"
 #include "vm/page.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 
+// Most pages written to swap as one cluster: as many as the block layer
+// will merge into a single transfer.
+#define SWAP_CLUSTER_PAGES (BLOCK_MAX_MERGE_SECTORS / SECTORS_PER_PAGE)
+
 void swaptable_init(void);
-void add_page_to_swapfile(struct page_info* p);
+void add_page_to_swapfile(struct page_info* p, uint32_t* pagedir,
+                          void* kpage);
+void add_pages_to_swapfile(struct page_info** pages, uint32_t** pagedirs,
+                           void** kpages, size_t cnt);
+size_t find_swapped_neighbors(struct page_info* p, uint32_t* pagedir,
+                              struct page_info** neighbors, size_t max);
 void load_swapped_page_into_frame(struct page_info* p, void* frame);
+void load_swapped_pages_into_frames(struct page_info** pages, void** frames,
+                                    size_t cnt);
+void copy_swapped_page_into_frame(struct page_info* p, void* frame);
+void move_swapped_page(struct page_info* from, struct page_info* to,
+                       uint32_t* pagedir);
+bool keep_swapped_copy(struct page_info* p, bool dirty);
 void delete_swapped_page(struct page_info* p);
+void swap_print_stats(void);
 
 #endif /* vm/swap.h */
@@ -0,0 +1,276 @@
+#include "vm/text.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+// The text cache holds the read-only pages of executables, so that every
+// process running a program maps the same frames instead of loading its
+// own copies. Cached pages are never written anywhere: on eviction they
+// are dropped, since the executable still has them. They also outlive
+// the processes that use them, so the next run of a program finds its
+// code in memory, until the clock takes the frames back or somebody
+// writes to the executable.
+
+// The cached pages of one executable.
+struct text_file {
+    struct inode *inode;        // The executable, kept open. The key.
+    struct list pages;          // Its cached pages.
+    struct hash_elem elem;      // Element in `text_files`.
+};
+
+// One cached page of an executable.
+struct text_page {
+    struct text_file *file;     // The executable.
+    off_t offset;               // Where in the file the page starts.
+    uint32_t num_bytes;         // Bytes from the file, the rest is zeros.
+    void *kpage;                // The frame, or NULL if not in memory.
+    bool loading;               // Whether a frame is being read in.
+    struct list mappings;       // The page_infos that map it.
+    struct list_elem elem;      // Element in the file's `pages`.
+};
+
+struct lock textcache_lock;
+
+// Signaled, with `textcache_lock` held, when a page is done loading.
+static struct condition page_loaded;
+
+// The executables with cached pages, keyed by inode.
+static struct hash text_files;
+
+// Text cache statistics.
+static long long hit_cnt;               // Pages mapped from memory.
+static long long miss_cnt;              // Pages read from their files.
+static long long drop_cnt;              // Pages evicted or invalidated.
+
+static unsigned text_file_hash(const struct hash_elem *e, void *aux UNUSED) {
+    struct text_file *file = hash_entry(e, struct text_file, elem);
+    return hash_bytes(&file->inode, sizeof(file->inode));
+}
+
+static bool text_file_less(const struct hash_elem *a,
+                           const struct hash_elem *b,
+                           void *aux UNUSED) {
+    struct text_file *file_a = hash_entry(a, struct text_file, elem);
+    struct text_file *file_b = hash_entry(b, struct text_file, elem);
+    return file_a->inode < file_b->inode;
+}
+
+void textcache_init(void) {
+    lock_init(&textcache_lock);
+    cond_init(&page_loaded);
+    hash_init(&text_files, text_file_hash, text_file_less, NULL);
+}
+
+// MARK: Lookup
+
+// Must be called with `textcache_lock` held. Returns the cached pages of
+// the executable with the given inode, creating an empty entry for it if
+// there is none and `create` is set. Otherwise returns NULL.
+static struct text_file *_textcache_find_file(struct inode *inode,
+                                              bool create) {
+    struct text_file lookup_entry;
+    lookup_entry.inode = inode;
+    struct hash_elem *e = hash_find(&text_files, &lookup_entry.elem);
+    if (e != NULL) return hash_entry(e, struct text_file, elem);
+    if (!create) return NULL;
+
+    struct text_file *file = malloc(sizeof(struct text_file));
+    if (file == NULL) {
+        PANIC("Unable to allocate memory to store text_file.");
+    }
+    file->inode = inode_reopen(inode);
+    file->inode->text_cached = true;
+    list_init(&file->pages);
+    hash_insert(&text_files, &file->elem);
+    return file;
+}
+
+// Must be called with `textcache_lock` held. Returns the cache entry that
+// shared page `page` maps, creating one that isn't in memory yet if need
+// be. Pages that have the same bytes from the same place in the same
+// executable are the same page.
+static struct text_page *_textcache_find_page(struct page_info *page) {
+    struct inode *inode = file_get_inode(page->file_info.file);
+    struct text_file *file = _textcache_find_file(inode, true);
+    struct list_elem *e;
+
+    for (e = list_begin(&file->pages); e != list_end(&file->pages);
+         e = list_next(e)) {
+        struct text_page *text = list_entry(e, struct text_page, elem);
+        if (text->offset == page->file_info.offset &&
+            text->num_bytes == page->file_info.num_bytes) {
+            return text;
+        }
+    }
+
+    struct text_page *text = malloc(sizeof(struct text_page));
+    if (text == NULL) {
+        PANIC("Unable to allocate memory to store text_page.");
+    }
+    text->file = file;
+    text->offset = page->file_info.offset;
+    text->num_bytes = page->file_info.num_bytes;
+    text->kpage = NULL;
+    text->loading = false;
+    list_init(&text->mappings);
+    list_push_back(&file->pages, &text->elem);
+    return text;
+}
+
+// Must be called with `textcache_lock` held. Forgets a page that is no
+// longer in memory or mapped anywhere, along with its executable if that
+// was its last cached page.
+static void _textcache_release_page(struct text_page *text) {
+    if (text->kpage != NULL || text->loading ||
+        !list_empty(&text->mappings)) return;
+
+    struct text_file *file = text->file;
+    list_remove(&text->elem);
+    free(text);
+
+    if (list_empty(&file->pages)) {
+        hash_delete(&text_files, &file->elem);
+        file->inode->text_cached = false;
+        inode_close(file->inode);
+        free(file);
+    }
+}
+
+// MARK: Mapping
+
+// Maps the shared page `page` into the current process, reading it in
+// first if it isn't cached yet. This should only be called by
+// `pagetable_load_page`.
+void textcache_load_page(struct page_info *page) {
+    ASSERT(page->shared.text);
+    ASSERT(page->state != LOADED_STATE);
+    ASSERT(is_user_vaddr(page->virtual_address));
+
+    lock_acquire(&textcache_lock);
+    struct text_page *text = _textcache_find_page(page);
+    if (text->kpage != NULL) hit_cnt++;
+
+    while (text->kpage == NULL) {
+        if (text->loading) {
+            // Somebody else is reading it in. Look it up again once
+            // they're done, since it may be gone again by then.
+            cond_wait(&page_loaded, &textcache_lock);
+            text = _textcache_find_page(page);
+            continue;
+        }
+
+        // Read the page in without the lock, since getting a frame may
+        // have to evict, and reading takes a while
+        text->loading = true;
+        lock_release(&textcache_lock);
+
+        void *kpage = frametable_create_page(0);
+        off_t bytes_read = file_read_at(page->file_info.file,
+                                        kpage,
+                                        page->file_info.num_bytes,
+                                        page->file_info.offset);
+        ASSERT(bytes_read == (off_t)page->file_info.num_bytes);
+        memset((char *)kpage + bytes_read, 0, PGSIZE - bytes_read);
+
+        // Hand the frame over to the cache. Evictors need our lock to
+        // do anything with it, so it can be unpinned right away.
+        lock_acquire(&textcache_lock);
+        struct frame_info *frame = frame_for_page(kpage);
+        frame->owner = NULL;
+        frame->text = text;
+        frame->is_pinned = false;
+        text->kpage = kpage;
+        text->loading = false;
+        miss_cnt++;
+        cond_broadcast(&page_loaded, &textcache_lock);
+    }
+
+    // Map it, read-only whatever the segment said
+    pagetable_map_shared(page, text->kpage, &text->mappings);
+    lock_release(&textcache_lock);
+}
+
+// Unmaps the shared page `page` from the current process, if it's mapped.
+// The cached page stays in memory for other processes.
+void textcache_unload_page(struct page_info *page) {
+    ASSERT(page->shared.text);
+
+    lock_acquire(&textcache_lock);
+    pagetable_unmap_shared(page);
+    lock_release(&textcache_lock);
+}
+
+// MARK: Eviction
+
+// Must be called with `textcache_lock` held. Whether the cached page has
+// been used, through any of its mappings or the kernel's alias of its
+// frame, since the last time its accessed bits were reset. If `clear` is
+// set, resets all of them.
+bool textcache_test_accessed(struct text_page *text, bool clear) {
+    ASSERT(lock_held_by_current_thread(&textcache_lock));
+    ASSERT(text->kpage != NULL);
+
+    return pagetable_shared_accessed(&text->mappings, text->kpage, clear);
+}
+
+// Must be called with `textcache_lock` held. Unmaps the cached page from
+// every process using it and drops it from the cache, without freeing its
+// frame. Returns the kernel address of the frame. The processes fault on
+// the page the next time they use it, and wait on the lock to map it again.
+void *textcache_evict_page(struct text_page *text) {
+    ASSERT(lock_held_by_current_thread(&textcache_lock));
+    ASSERT(text->kpage != NULL);
+
+    pagetable_unmap_all_shared(&text->mappings);
+
+    void *kpage = text->kpage;
+    text->kpage = NULL;
+    drop_cnt++;
+    _textcache_release_page(text);
+    return kpage;
+}
+
+// Drops the cached pages of the executable with the given inode, which is
+// about to be written to. The file system only calls this for inodes marked
+// `text_cached`, after checking that writes to them aren't denied, but
+// without our lock, so an exec may have started using the executable since.
+// In that case the pages it is reading in or has mapped are left alone and
+// false is returned, and the write must fail as if it had been denied.
+bool textcache_invalidate(struct inode *inode) {
+    lock_acquire(&textcache_lock);
+    if (inode->deny_write_cnt > 0) {
+        lock_release(&textcache_lock);
+        return false;
+    }
+
+    bool success = true;
+    struct text_file *file = _textcache_find_file(inode, false);
+    struct list_elem *e = file != NULL ? list_begin(&file->pages) : NULL;
+    while (e != NULL && e != list_end(&file->pages)) {
+        struct text_page *text = list_entry(e, struct text_page, elem);
+        e = list_next(e);
+        if (text->loading || !list_empty(&text->mappings)) {
+            success = false;
+            continue;
+        }
+
+        // Dropping the last page drops the file too
+        bool last = list_size(&file->pages) == 1;
+        frametable_free_page(textcache_evict_page(text));
+        if (last) e = NULL;
+    }
+    lock_release(&textcache_lock);
+    return success;
+}
+
+// Prints text cache statistics.
+void textcache_print_stats(void) {
+    printf("Text cache: %lld hits, %lld misses, %lld pages dropped\n",
+           hit_cnt, miss_cnt, drop_cnt);
+}
@@ -0,0 +1,23 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+
+#include <stdbool.h>
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "vm/page.h"
+
+struct text_page;
+
+// Guards the text cache, including the mappings of every cached page.
+// Like the pagetable locks, evictors only ever try to acquire it.
+extern struct lock textcache_lock;
+
+void textcache_init(void);
+void textcache_load_page(struct page_info *page);
+void textcache_unload_page(struct page_info *page);
+bool textcache_test_accessed(struct text_page *text, bool clear);
+void *textcache_evict_page(struct text_page *text);
+bool textcache_invalidate(struct inode *inode);
+void textcache_print_stats(void);
+
+#endif /* vm/text.h */